@@ -157,6 +157,20 @@ update_mmu_cache(struct vm_area_struct *vma, unsigned long address, pte_t pte)
 	__update_tlb(vma, address, pte);
 }
 
+#ifdef CONFIG_TRANSPARENT_LARGE_PAGE
+/*
+ * A naturally aligned, physically contiguous group of 4kB ptes with
+ * identical protections is loaded into the UTLB as a single 64kB entry.
+ */
+#define LARGE_PAGE_SHIFT	16
+#define LARGE_PAGE_SIZE		(1UL << LARGE_PAGE_SHIFT)
+#define LARGE_PAGE_MASK		(~(LARGE_PAGE_SIZE - 1))
+#define LARGE_PAGE_ORDER	(LARGE_PAGE_SHIFT - PAGE_SHIFT)
+#define LARGE_PAGE_NR		(1 << LARGE_PAGE_ORDER)
+
+extern int __update_tlb_large(pte_t *ptep, unsigned long address);
+#endif
+
 extern pgd_t swapper_pg_dir[PTRS_PER_PGD];
 extern void paging_init(void);
 extern void page_table_range_init(unsigned long start, unsigned long end,
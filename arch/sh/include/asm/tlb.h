@@ -97,6 +97,23 @@ tlb_end_vma(struct mmu_gather *tlb, struct vm_area_struct *vma)
 
 #define tlb_migrate_finish(mm)		do { } while (0)
 
+/*
+ * TLB miss accounting for the 32-bit fast path, reported through
+ * debugfs by arch/sh/mm/tlb-debugfs.c.
+ */
+struct tlb_miss_stats {
+	unsigned long	refill;		/* refilled by handle_tlbmiss() */
+	unsigned long	large;		/* ... of which with a 64kB entry */
+	unsigned long	fault;		/* handed on to do_page_fault() */
+};
+
+#if defined(CONFIG_DEBUG_FS) && defined(CONFIG_SUPERH32)
+DECLARE_PER_CPU(struct tlb_miss_stats, tlb_miss_stats);
+#define count_tlb_miss(item)	(__get_cpu_var(tlb_miss_stats).item++)
+#else
+#define count_tlb_miss(item)	do { } while (0)
+#endif
+
 #else /* CONFIG_MMU */
 
 #define tlb_start_vma(tlb, vma)				do { } while (0)
@@ -20,6 +20,7 @@
 #include <asm/system.h>
 #include <asm/mmu_context.h>
 #include <asm/tlbflush.h>
+#include <asm/tlb.h>
 
 #ifdef CONFIG_MMU
 
@@ -389,23 +390,23 @@ handle_tlbmiss(struct pt_regs *regs, unsigned long writeaccess,
 		pgd = pgd_offset_k(address);
 	} else {
 		if (unlikely(address >= TASK_SIZE || !current->mm))
-			return 1;
+			goto fault;
 
 		pgd = pgd_offset(current->mm, address);
 	}
 
 	pud = pud_offset(pgd, address);
 	if (pud_none_or_clear_bad(pud))
-		return 1;
+		goto fault;
 	pmd = pmd_offset(pud, address);
 	if (pmd_none_or_clear_bad(pmd))
-		return 1;
+		goto fault;
 	pte = pte_offset_kernel(pmd, address);
 	entry = *pte;
 	if (unlikely(pte_none(entry) || pte_not_present(entry)))
-		return 1;
+		goto fault;
 	if (unlikely(writeaccess && !pte_write(entry)))
-		return 1;
+		goto fault;
 
 	if (writeaccess)
 		entry = pte_mkdirty(entry);
@@ -423,7 +424,24 @@ handle_tlbmiss(struct pt_regs *regs, unsigned long writeaccess,
 		local_flush_tlb_one(get_asid(), address & PAGE_MASK);
 #endif
 
+	count_tlb_miss(refill);
+
+#ifdef CONFIG_TRANSPARENT_LARGE_PAGE
+	if (address < TASK_SIZE) {
+		__update_cache(NULL, address, entry);
+		if (__update_tlb_large(pte, address))
+			count_tlb_miss(large);
+		else
+			__update_tlb(NULL, address, entry);
+		return 0;
+	}
+#endif
+
 	update_mmu_cache(NULL, address, entry);
 
 	return 0;
+
+fault:
+	count_tlb_miss(fault);
+	return 1;
 }
@@ -0,0 +1,68 @@
+/*
+ * debugfs ops for TLB miss accounting
+ *
+ * Provides a debugfs file that reports, per CPU, how many UTLB misses
+ * were refilled directly from the page tables by the fast path, how many
+ * of those refills loaded a 64kB entry for a transparent large page, and
+ * how many misses had to be handed on to the page fault handler.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <asm/processor.h>
+#include <asm/tlb.h>
+
+DEFINE_PER_CPU(struct tlb_miss_stats, tlb_miss_stats);
+
+static int tlb_seq_show(struct seq_file *file, void *iter)
+{
+	int cpu;
+
+	seq_printf(file, "cpu %12s %12s %12s\n", "refill", "large", "fault");
+
+	for_each_online_cpu(cpu) {
+		struct tlb_miss_stats *stats = &per_cpu(tlb_miss_stats, cpu);
+
+		seq_printf(file, "%3d %12lu %12lu %12lu\n", cpu,
+			   stats->refill, stats->large, stats->fault);
+	}
+
+	return 0;
+}
+
+static int tlb_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tlb_seq_show, inode->i_private);
+}
+
+static const struct file_operations tlb_debugfs_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tlb_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init tlb_debugfs_init(void)
+{
+	struct dentry *tlb_dentry;
+
+	tlb_dentry = debugfs_create_file("tlb_misses", S_IRUSR,
+					 sh_debugfs_root, NULL,
+					 &tlb_debugfs_fops);
+	if (!tlb_dentry)
+		return -ENOMEM;
+	if (IS_ERR(tlb_dentry))
+		return PTR_ERR(tlb_dentry);
+
+	return 0;
+}
+module_init(tlb_debugfs_init);
+
+MODULE_LICENSE("GPL v2");
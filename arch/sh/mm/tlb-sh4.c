@@ -15,20 +15,11 @@
 #include <asm/mmu_context.h>
 #include <asm/cacheflush.h>
 
-void __update_tlb(struct vm_area_struct *vma, unsigned long address, pte_t pte)
+static inline void __load_tlb(unsigned long vpn, pte_t pte)
 {
-	unsigned long flags, pteval, vpn;
-
-	/*
-	 * Handle debugger faulting in for debugee.
-	 */
-	if (vma && current->active_mm != vma->vm_mm)
-		return;
-
-	local_irq_save(flags);
+	unsigned long pteval;
 
 	/* Set PTEH register */
-	vpn = (address & MMU_VPN_MASK) | get_asid();
 	ctrl_outl(vpn, MMU_PTEH);
 
 	pteval = pte.pte_low;
@@ -61,8 +52,100 @@ void __update_tlb(struct vm_area_struct *vma, unsigned long address, pte_t pte)
 
 	/* Load the TLB */
 	asm volatile("ldtlb": /* no output */ : /* no input */ : "memory");
+}
+
+void __update_tlb(struct vm_area_struct *vma, unsigned long address, pte_t pte)
+{
+	unsigned long flags;
+
+	/*
+	 * Handle debugger faulting in for debugee.
+	 */
+	if (vma && current->active_mm != vma->vm_mm)
+		return;
+
+	local_irq_save(flags);
+	__load_tlb((address & MMU_VPN_MASK) | get_asid(), pte);
+	local_irq_restore(flags);
+}
+
+#ifdef CONFIG_TRANSPARENT_LARGE_PAGE
+/*
+ * Called from the TLB miss fast path once the pte at @ptep has been
+ * updated for @address.  If the naturally aligned group of ptes around
+ * it maps physically contiguous memory with identical protections, map
+ * the whole group with one 64kB UTLB entry and return 1; otherwise
+ * return 0 and leave the refill to __update_tlb().
+ *
+ * The UTLB entry cannot tell which of the pages is used, so all ptes of
+ * the group are marked young when it is loaded, as with a huge page;
+ * otherwise reclaim would see only the faulting page as referenced and
+ * evict the others while they are hot.  The accessed bit is therefore
+ * ignored when checking that the group is uniform.
+ *
+ * Nothing else about this is recorded in the page tables.  Every change to
+ * one of the ptes is followed by a flush of its address, the associative
+ * UTLB write used for that matches on the size of the entry and so drops
+ * the 64kB entry, and the next miss finds the group no longer uniform
+ * and refills at 4kB.
+ */
+int __uses_jump_to_uncached __update_tlb_large(pte_t *ptep,
+					       unsigned long address)
+{
+	pte_t *first = ptep - ((address >> PAGE_SHIFT) & (LARGE_PAGE_NR - 1));
+	unsigned long pteval = first->pte_low & ~_PAGE_ACCESSED;
+	unsigned long pfn = pteval >> PAGE_SHIFT;
+	unsigned long flags, vpn;
+	int i;
+
+	if ((pfn & (LARGE_PAGE_NR - 1)) || !pfn_valid(pfn) ||
+	    !(pteval & _PAGE_PRESENT))
+		return 0;
+
+	/*
+	 * A clean writable group would have to take an initial page write
+	 * exception for each of its pages, leave those to 4kB entries.
+	 */
+	if ((pteval & (_PAGE_RW | _PAGE_DIRTY)) == _PAGE_RW)
+		return 0;
+
+	for (i = 1; i < LARGE_PAGE_NR; i++)
+		if ((first[i].pte_low & ~_PAGE_ACCESSED) !=
+		    pteval + (i << PAGE_SHIFT))
+			return 0;
+
+	/* __update_cache() has only written back the faulting page */
+	if (boot_cpu_data.dcache.n_aliases)
+		for (i = 0; i < LARGE_PAGE_NR; i++)
+			if (test_bit(PG_dcache_dirty,
+				     &pfn_to_page(pfn + i)->flags))
+				return 0;
+
+	for (i = 0; i < LARGE_PAGE_NR; i++)
+		if (!pte_young(first[i]))
+			set_pte(&first[i], pte_mkyoung(first[i]));
+
+	vpn = (address & LARGE_PAGE_MASK) | get_asid();
+
+	local_irq_save(flags);
+
+	/*
+	 * The UTLB must never hold two entries matching one address, so
+	 * first drop the 4kB entries of the group that are still loaded.
+	 */
+	jump_to_uncached();
+	for (i = 0; i < LARGE_PAGE_NR; i++)
+		ctrl_outl(vpn + (i << PAGE_SHIFT),
+			  MMU_UTLB_ADDRESS_ARRAY | MMU_PAGE_ASSOC_BIT);
+	back_to_cached();
+
+	__load_tlb(vpn, __pte((first->pte_low & ~_PAGE_SZ_MASK) | _PAGE_SZ1));
+
 	local_irq_restore(flags);
+
+	return 1;
 }
+#endif
 
 void __uses_jump_to_uncached local_flush_tlb_one(unsigned long asid,
 						 unsigned long page)
@@ -61,4 +61,6 @@
 #define SO_SECURITY_ENCRYPTION_TRANSPORT	0x5002
 #define SO_SECURITY_ENCRYPTION_NETWORK		0x5004
 
+#define SO_MAX_PACING_RATE	0x0031
+
 #endif /* _ASM_SOCKET_H */
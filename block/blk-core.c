@@ -1726,6 +1726,10 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 		part = disk_map_sector_rcu(req->rq_disk, blk_rq_pos(req));
 		part_stat_add(cpu, part, sectors[rw], bytes >> 9);
 		part_stat_unlock();
+
+		if (rw == READ)
+			bdi_account_read(&req->q->backing_dev_info, bytes,
+				jiffies_to_usecs(jiffies - req->start_time));
 	}
 }
 
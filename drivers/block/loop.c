@@ -573,7 +573,13 @@ static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
 	} else {
+		ktime_t start = ktime_get();
+		unsigned int size = bio->bi_size;
 		int ret = do_bio_filebacked(lo, bio);
+
+		if (bio_rw(bio) != WRITE && !ret)
+			bdi_account_read(&lo->lo_queue->backing_dev_info, size,
+					 ktime_us_delta(ktime_get(), start));
 		bio_endio(bio, ret);
 	}
 }
@@ -44,7 +44,9 @@ struct stmmac_priv {
 	unsigned int cur_rx;
 	unsigned int dirty_rx;
 	struct sk_buff **rx_skbuff;
+	void **rx_buff;		/* bare data buffers when rx_frag_size != 0 */
 	dma_addr_t *rx_skbuff_dma;
+	unsigned int rx_frag_size;
 	struct sk_buff_head rx_recycle;
 
 	struct net_device *dev;
@@ -479,6 +479,57 @@ static int stmmac_set_bfsize(int mtu, int bufsize)
 	return ret;
 }
 
+/**
+ * stmmac_rx_alloc_frag - attach a page fragment to an RX descriptor slot
+ * @priv: driver private structure
+ * @entry: RX ring index
+ * Description: the buffer is mapped so that the frame starts after
+ * NET_SKB_PAD + NET_IP_ALIGN bytes of headroom and build_skb() can later
+ * wrap it without copying.
+ */
+static int stmmac_rx_alloc_frag(struct stmmac_priv *priv, unsigned int entry)
+{
+	void *data = netdev_alloc_frag(priv->rx_frag_size);
+
+	if (unlikely(!data))
+		return -ENOMEM;
+
+	priv->rx_buff[entry] = data;
+	priv->rx_skbuff_dma[entry] =
+	    dma_map_single(priv->device, data + NET_SKB_PAD + NET_IP_ALIGN,
+			   priv->dma_buf_sz, DMA_FROM_DEVICE);
+	return 0;
+}
+
+/**
+ * stmmac_rx_build_skb - wrap a received page fragment into an skb
+ * @priv: driver private structure
+ * @entry: RX ring index
+ * @frame_len: length of the received frame
+ * Description: the sk_buff is allocated only now that the frame has
+ * landed, so its header is cache hot when handed to the stack.
+ */
+static struct sk_buff *stmmac_rx_build_skb(struct stmmac_priv *priv,
+					   unsigned int entry, int frame_len)
+{
+	void *data = priv->rx_buff[entry];
+	struct sk_buff *skb;
+
+	priv->rx_buff[entry] = NULL;
+	dma_unmap_single(priv->device, priv->rx_skbuff_dma[entry],
+			 priv->dma_buf_sz, DMA_FROM_DEVICE);
+	prefetch(data + NET_SKB_PAD);
+
+	skb = build_skb(data, priv->rx_frag_size);
+	if (unlikely(!skb)) {
+		netdev_free_frag(data);
+		return NULL;
+	}
+	skb_reserve(skb, NET_SKB_PAD + NET_IP_ALIGN);
+	skb_put(skb, frame_len);
+	return skb;
+}
+
 /**
  * init_dma_desc_rings - init the RX/TX descriptor rings
  * @dev: net device structure
@@ -515,9 +566,16 @@ static void init_dma_desc_rings(struct net_device *dev)
 	DBG(probe, INFO, "stmmac: txsize %d, rxsize %d, bfsize %d\n",
 	    txsize, rxsize, bfsize);
 
+	/* Frames that fit in a page fragment are received into bare data
+	 * buffers; the sk_buff is only built once the frame has landed. */
+	priv->rx_frag_size = SKB_FRAG_SIZE(NET_IP_ALIGN + bfsize);
+	if (priv->rx_frag_size > PAGE_SIZE)
+		priv->rx_frag_size = 0;
+
 	priv->rx_skbuff_dma = kmalloc(rxsize * sizeof(dma_addr_t), GFP_KERNEL);
 	priv->rx_skbuff =
-	    kmalloc(sizeof(struct sk_buff *) * rxsize, GFP_KERNEL);
+	    kzalloc(sizeof(struct sk_buff *) * rxsize, GFP_KERNEL);
+	priv->rx_buff = kzalloc(sizeof(void *) * rxsize, GFP_KERNEL);
 	priv->dma_rx =
 	    (struct dma_desc *)dma_alloc_coherent(priv->device,
 						  rxsize *
@@ -547,31 +605,42 @@ static void init_dma_desc_rings(struct net_device *dev)
 	DBG(probe, INFO, "stmmac: SKB addresses:\n"
 			 "skb\t\tskb data\tdma data\n");
 
+	priv->dma_buf_sz = bfsize;
+	buf_sz = bfsize;
+
 	for (i = 0; i < rxsize; i++) {
 		struct dma_desc *p = priv->dma_rx + i;
 
-		skb = __netdev_alloc_skb(dev, bfsize + NET_IP_ALIGN,
-					 GFP_KERNEL);
-		if (unlikely(skb == NULL)) {
-			pr_err("%s: Rx init fails; skb is NULL\n", __func__);
-			break;
+		if (priv->rx_frag_size) {
+			if (unlikely(stmmac_rx_alloc_frag(priv, i))) {
+				pr_err("%s: Rx init fails; no frag\n",
+				       __func__);
+				break;
+			}
+		} else {
+			skb = __netdev_alloc_skb(dev, bfsize + NET_IP_ALIGN,
+						 GFP_KERNEL);
+			if (unlikely(skb == NULL)) {
+				pr_err("%s: Rx init fails; skb is NULL\n",
+				       __func__);
+				break;
+			}
+			skb_reserve(skb, NET_IP_ALIGN);
+			priv->rx_skbuff[i] = skb;
+			priv->rx_skbuff_dma[i] = dma_map_single(priv->device,
+						skb->data, bfsize,
+						DMA_FROM_DEVICE);
 		}
-		skb_reserve(skb, NET_IP_ALIGN);
-		priv->rx_skbuff[i] = skb;
-		priv->rx_skbuff_dma[i] = dma_map_single(priv->device, skb->data,
-						bfsize, DMA_FROM_DEVICE);
 
 		p->des2 = priv->rx_skbuff_dma[i];
 
 		priv->hw->ring->init_desc3(des3_as_data_buf, p);
 
 		DBG(probe, INFO, "[%p]\t[%p]\t[%x]\n", priv->rx_skbuff[i],
-			priv->rx_skbuff[i]->data, priv->rx_skbuff_dma[i]);
+			priv->rx_buff[i], priv->rx_skbuff_dma[i]);
 	}
 	priv->cur_rx = 0;
 	priv->dirty_rx = (unsigned int)(i - rxsize);
-	priv->dma_buf_sz = bfsize;
-	buf_sz = bfsize;
 
 	/* TX INITIALIZATION */
 	for (i = 0; i < txsize; i++) {
@@ -610,6 +679,12 @@ static void dma_free_rx_skbufs(struct stmmac_priv *priv)
 			dev_kfree_skb_any(priv->rx_skbuff[i]);
 		}
 		priv->rx_skbuff[i] = NULL;
+		if (priv->rx_buff[i]) {
+			dma_unmap_single(priv->device, priv->rx_skbuff_dma[i],
+					 priv->dma_buf_sz, DMA_FROM_DEVICE);
+			netdev_free_frag(priv->rx_buff[i]);
+		}
+		priv->rx_buff[i] = NULL;
 	}
 }
 
@@ -646,6 +721,7 @@ static void free_dma_desc_resources(struct stmmac_priv *priv)
 			  priv->dma_rx, priv->dma_rx_phy);
 	kfree(priv->rx_skbuff_dma);
 	kfree(priv->rx_skbuff);
+	kfree(priv->rx_buff);
 	kfree(priv->tx_skbuff);
 }
 
@@ -722,7 +798,8 @@ static void stmmac_tx(struct stmmac_priv *priv)
 			 * we add this skb back into the pool,
 			 * if it's the right size.
 			 */
-			if ((skb_queue_len(&priv->rx_recycle) <
+			if (!priv->rx_frag_size &&
+				(skb_queue_len(&priv->rx_recycle) <
 				priv->dma_rx_size) &&
 				skb_recycle_check(skb, priv->dma_buf_sz))
 				__skb_queue_head(&priv->rx_recycle, skb);
@@ -1407,7 +1484,19 @@ static inline void stmmac_rx_refill(struct stmmac_priv *priv)
 
 	for (; priv->cur_rx - priv->dirty_rx > 0; priv->dirty_rx++) {
 		unsigned int entry = priv->dirty_rx % rxsize;
-		if (likely(priv->rx_skbuff[entry] == NULL)) {
+
+		if (priv->rx_frag_size) {
+			if (likely(priv->rx_buff[entry] == NULL)) {
+				if (unlikely(stmmac_rx_alloc_frag(priv, entry)))
+					break;
+
+				(p + entry)->des2 = priv->rx_skbuff_dma[entry];
+
+				if (unlikely(priv->plat->has_gmac))
+					priv->hw->ring->refill_desc3(bfsize,
+								     p + entry);
+			}
+		} else if (likely(priv->rx_skbuff[entry] == NULL)) {
 			struct sk_buff *skb;
 
 			skb = __skb_dequeue(&priv->rx_recycle);
@@ -1482,20 +1571,36 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 				pr_debug("\tdesc: %p [entry %d] buff=0x%x\n",
 					p, entry, p->des2);
 #endif
-			skb = priv->rx_skbuff[entry];
-			if (unlikely(!skb)) {
-				pr_err("%s: Inconsistent Rx descriptor chain\n",
-					priv->dev->name);
-				priv->dev->stats.rx_dropped++;
-				break;
+			if (priv->rx_frag_size) {
+				if (unlikely(!priv->rx_buff[entry])) {
+					pr_err("%s: Inconsistent Rx descriptor "
+					       "chain\n", priv->dev->name);
+					priv->dev->stats.rx_dropped++;
+					break;
+				}
+				skb = stmmac_rx_build_skb(priv, entry,
+							  frame_len);
+				if (unlikely(!skb)) {
+					priv->dev->stats.rx_dropped++;
+					goto next;
+				}
+			} else {
+				skb = priv->rx_skbuff[entry];
+				if (unlikely(!skb)) {
+					pr_err("%s: Inconsistent Rx descriptor "
+					       "chain\n", priv->dev->name);
+					priv->dev->stats.rx_dropped++;
+					break;
+				}
+				prefetch(skb->data - NET_IP_ALIGN);
+				priv->rx_skbuff[entry] = NULL;
+
+				skb_put(skb, frame_len);
+				dma_unmap_single(priv->device,
+						 priv->rx_skbuff_dma[entry],
+						 priv->dma_buf_sz,
+						 DMA_FROM_DEVICE);
 			}
-			prefetch(skb->data - NET_IP_ALIGN);
-			priv->rx_skbuff[entry] = NULL;
-
-			skb_put(skb, frame_len);
-			dma_unmap_single(priv->device,
-					 priv->rx_skbuff_dma[entry],
-					 priv->dma_buf_sz, DMA_FROM_DEVICE);
 #ifdef STMMAC_RX_DEBUG
 			if (netif_msg_pktdata(priv)) {
 				pr_info(" frame received (%dbytes)", frame_len);
@@ -1517,6 +1622,7 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 			priv->dev->stats.rx_bytes += frame_len;
 			priv->dev->last_rx = jiffies;
 		}
+next:
 		entry = next_entry;
 		p = p_next;	/* use prefetched values */
 	}
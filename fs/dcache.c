@@ -106,7 +106,9 @@ static void dentry_iput(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_inode = NULL;
+		write_seqcount_end(&dentry->d_seq);
 		list_del_init(&dentry->d_alias);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -942,6 +944,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
@@ -1421,6 +1424,55 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking a reference
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seq: returns the d_seq of the dentry found
+ *
+ * Must be called under rcu_read_lock().  Only usable for parents without
+ * a ->d_compare method.  Nothing is pinned: the caller must check the
+ * returned dentry against @seq with read_seqcount_retry() after it has
+ * loaded whatever it wants from it, and must take d_lock and recheck
+ * before grabbing a reference.
+ */
+struct dentry * __d_lookup_rcu(struct dentry * parent, struct qstr * name,
+			       unsigned *seq)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent,hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		unsigned s;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+seqretry:
+		s = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		/*
+		 * The name may be changing under us; a mismatch only counts
+		 * if d_seq says the name we compared was a stable one.
+		 */
+		if (dentry->d_name.len != len ||
+		    memcmp(dentry->d_name.name, str, len)) {
+			if (read_seqcount_retry(&dentry->d_seq, s))
+				goto seqretry;
+			continue;
+		}
+		*seq = s;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1650,6 +1702,9 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&target->d_seq);
+
 	/* Move the dentry to the target hash queue, if on different bucket */
 	if (d_unhashed(dentry))
 		goto already_unhashed;
@@ -1683,6 +1738,8 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1776,6 +1833,7 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 {
 	struct dentry *dparent, *aparent;
 
+	write_seqcount_begin(&anon->d_seq);
 	switch_names(dentry, anon);
 	swap(dentry->d_name.hash, anon->d_name.hash);
 
@@ -1795,6 +1853,7 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 		list_add(&anon->d_u.d_child, &anon->d_parent->d_subdirs);
 	else
 		INIT_LIST_HEAD(&anon->d_u.d_child);
+	write_seqcount_end(&anon->d_seq);
 
 	anon->d_flags &= ~DCACHE_DISCONNECTED;
 }
@@ -18,6 +18,7 @@
 #include <linux/time.h>
 #include <linux/buffer_head.h>
 #include <linux/compat.h>
+#include <linux/hash.h>
 #include <asm/uaccess.h>
 #include "fat.h"
 
@@ -338,113 +339,448 @@ parse_long:
 }
 
 /*
- * Return values: negative -> error, 0 -> not found, positive -> found,
- * value is the total amount of slots, including the shortname entry.
+ * Read the next directory record, i.e. an in-use shortname entry and the
+ * longname slots before it, starting at *pos.  On success, *de is the
+ * shortname entry and *nr_slots the number of longname slots, whose name
+ * is in *unicode.  Returns PARSE_EOF at the end of the directory.
  */
-int fat_search_long(struct inode *inode, const unsigned char *name,
-		    int name_len, struct fat_slot_info *sinfo)
+static int fat_get_record(struct inode *dir, loff_t *pos,
+			  struct buffer_head **bh, struct msdos_dir_entry **de,
+			  wchar_t **unicode, unsigned char *nr_slots)
 {
-	struct super_block *sb = inode->i_sb;
-	struct msdos_sb_info *sbi = MSDOS_SB(sb);
-	struct buffer_head *bh = NULL;
-	struct msdos_dir_entry *de;
-	struct nls_table *nls_disk = sbi->nls_disk;
-	unsigned char nr_slots;
-	wchar_t bufuname[14];
-	wchar_t *unicode = NULL;
-	unsigned char work[MSDOS_NAME];
-	unsigned char bufname[FAT_MAX_SHORT_SIZE];
-	unsigned short opt_shortname = sbi->options.shortname;
-	loff_t cpos = 0;
-	int chl, i, j, last_u, err, len;
-
-	err = -ENOENT;
 	while (1) {
-		if (fat_get_entry(inode, &cpos, &bh, &de) == -1)
-			goto end_of_dir;
+		if (fat_get_entry(dir, pos, bh, de) == -1)
+			return PARSE_EOF;
 parse_record:
-		nr_slots = 0;
-		if (de->name[0] == DELETED_FLAG)
+		*nr_slots = 0;
+		if ((*de)->name[0] == DELETED_FLAG)
 			continue;
-		if (de->attr != ATTR_EXT && (de->attr & ATTR_VOLUME))
+		if ((*de)->attr != ATTR_EXT && ((*de)->attr & ATTR_VOLUME))
 			continue;
-		if (de->attr != ATTR_EXT && IS_FREE(de->name))
+		if ((*de)->attr != ATTR_EXT && IS_FREE((*de)->name))
 			continue;
-		if (de->attr == ATTR_EXT) {
-			int status = fat_parse_long(inode, &cpos, &bh, &de,
-						    &unicode, &nr_slots);
-			if (status < 0) {
-				err = status;
-				goto end_of_dir;
-			} else if (status == PARSE_INVALID)
+		if ((*de)->attr == ATTR_EXT) {
+			int status = fat_parse_long(dir, pos, bh, de,
+						    unicode, nr_slots);
+			if (status < 0)
+				return status;
+			else if (status == PARSE_INVALID)
 				continue;
 			else if (status == PARSE_NOT_LONGNAME)
 				goto parse_record;
 			else if (status == PARSE_EOF)
-				goto end_of_dir;
+				return PARSE_EOF;
 		}
+		return 0;
+	}
+}
 
-		/*
-		 * The FAT_NO_83NAME flag is used to mark files
-		 * created with no 8.3 short name
-		 */
-		if (de->lcase & FAT_NO_83NAME)
-			goto compare_longname;
-
-		memcpy(work, de->name, sizeof(de->name));
-		/* see namei.c, msdos_format_name */
-		if (work[0] == 0x05)
-			work[0] = 0xE5;
-		for (i = 0, j = 0, last_u = 0; i < 8;) {
-			if (!work[i])
-				break;
-			chl = fat_shortname2uni(nls_disk, &work[i], 8 - i,
-						&bufuname[j++], opt_shortname,
-						de->lcase & CASE_LOWER_BASE);
-			if (chl <= 1) {
-				if (work[i] != ' ')
-					last_u = j;
-			} else {
+/* Convert the shortname of de for comparison, returns 0 if it has none */
+static int fat_record_shortname(struct msdos_sb_info *sbi,
+				struct msdos_dir_entry *de,
+				unsigned char *bufname)
+{
+	struct nls_table *nls_disk = sbi->nls_disk;
+	wchar_t bufuname[14];
+	unsigned char work[MSDOS_NAME];
+	unsigned short opt_shortname = sbi->options.shortname;
+	int chl, i, j, last_u;
+
+	memcpy(work, de->name, sizeof(de->name));
+	/* see namei.c, msdos_format_name */
+	if (work[0] == 0x05)
+		work[0] = 0xE5;
+	for (i = 0, j = 0, last_u = 0; i < 8;) {
+		if (!work[i])
+			break;
+		chl = fat_shortname2uni(nls_disk, &work[i], 8 - i,
+					&bufuname[j++], opt_shortname,
+					de->lcase & CASE_LOWER_BASE);
+		if (chl <= 1) {
+			if (work[i] != ' ')
 				last_u = j;
-			}
-			i += chl;
+		} else {
+			last_u = j;
 		}
-		j = last_u;
-		fat_short2uni(nls_disk, ".", 1, &bufuname[j++]);
-		for (i = 8; i < MSDOS_NAME;) {
-			if (!work[i])
-				break;
-			chl = fat_shortname2uni(nls_disk, &work[i],
-						MSDOS_NAME - i,
-						&bufuname[j++], opt_shortname,
-						de->lcase & CASE_LOWER_EXT);
-			if (chl <= 1) {
-				if (work[i] != ' ')
-					last_u = j;
-			} else {
+		i += chl;
+	}
+	j = last_u;
+	fat_short2uni(nls_disk, ".", 1, &bufuname[j++]);
+	for (i = 8; i < MSDOS_NAME;) {
+		if (!work[i])
+			break;
+		chl = fat_shortname2uni(nls_disk, &work[i],
+					MSDOS_NAME - i,
+					&bufuname[j++], opt_shortname,
+					de->lcase & CASE_LOWER_EXT);
+		if (chl <= 1) {
+			if (work[i] != ' ')
 				last_u = j;
-			}
-			i += chl;
+		} else {
+			last_u = j;
+		}
+		i += chl;
+	}
+	if (!last_u)
+		return 0;
+
+	bufuname[last_u] = 0x0000;
+	return fat_uni_to_x8(sbi, bufuname, bufname, FAT_MAX_SHORT_SIZE);
+}
+
+/* The names a record read by fat_get_record() can be looked up by */
+struct fat_record_names {
+	unsigned char *shortname;
+	int short_len;
+	unsigned char *longname;
+	int long_len;
+};
+
+/* Returns zero if the record cannot be looked up at all */
+static int fat_record_names(struct msdos_sb_info *sbi,
+			    struct msdos_dir_entry *de, wchar_t *unicode,
+			    unsigned char nr_slots, struct fat_record_names *rn)
+{
+	rn->short_len = rn->long_len = 0;
+
+	/*
+	 * The FAT_NO_83NAME flag is used to mark files
+	 * created with no 8.3 short name
+	 */
+	if (!(de->lcase & FAT_NO_83NAME)) {
+		rn->short_len = fat_record_shortname(sbi, de, rn->shortname);
+		if (!rn->short_len)
+			return 0;
+	}
+	if (nr_slots) {
+		rn->longname = (unsigned char *)(unicode + FAT_MAX_UNI_CHARS);
+		rn->long_len = fat_uni_to_x8(sbi, unicode, rn->longname,
+					     PATH_MAX - FAT_MAX_UNI_SIZE);
+	}
+	return 1;
+}
+
+static int fat_record_match(struct msdos_sb_info *sbi,
+			    const unsigned char *name, int name_len,
+			    struct fat_record_names *rn)
+{
+	/* Compare shortname */
+	if (rn->short_len &&
+	    fat_name_match(sbi, name, name_len, rn->shortname, rn->short_len))
+		return 1;
+	/* Compare longname */
+	if (rn->long_len &&
+	    fat_name_match(sbi, name, name_len, rn->longname, rn->long_len))
+		return 1;
+	return 0;
+}
+
+/*
+ * Name index of large directories.
+ *
+ * fat_search_long() has to convert the names of all records it passes,
+ * which makes lookups in directories of thousands of files expensive.
+ * So on the first lookup in a large directory, the hashes of all names
+ * are collected once, and later lookups only look at the records whose
+ * name hashes match.  fat_add_entries() and fat_remove_entries() keep
+ * the index up to date; if that fails, it is dropped and rebuilt by the
+ * next lookup.  Like all directory changes, it is protected by
+ * lock_super().
+ */
+#define FAT_DIR_INDEX_MIN_SIZE	(256 * sizeof(struct msdos_dir_entry))
+#define FAT_DIR_INDEX_MAX_BITS	12
+
+struct fat_dir_index {
+	unsigned int bits;
+	struct hlist_head hash[0];
+};
+
+struct fat_dir_index_entry {
+	struct hlist_node hash;
+	loff_t pos;			/* start of the record */
+	unsigned int name_hash;
+	unsigned char nr_slots;		/* longname slots of the record */
+};
+
+static struct kmem_cache *fat_dir_index_cachep;
+
+int __init fat_dir_index_init(void)
+{
+	fat_dir_index_cachep = kmem_cache_create("fat_dir_index",
+				sizeof(struct fat_dir_index_entry),
+				0, SLAB_RECLAIM_ACCOUNT|SLAB_MEM_SPREAD,
+				NULL);
+	if (fat_dir_index_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void fat_dir_index_destroy(void)
+{
+	kmem_cache_destroy(fat_dir_index_cachep);
+}
+
+/* Must match fat_name_match() */
+static unsigned int fat_name_hash(struct msdos_sb_info *sbi,
+				  const unsigned char *name, int len)
+{
+	unsigned long hash;
+
+	if (sbi->options.name_check == 's')
+		return full_name_hash(name, len);
+
+	hash = init_name_hash();
+	while (len--)
+		hash = partial_name_hash(nls_tolower(sbi->nls_io, *name++),
+					 hash);
+	return end_name_hash(hash);
+}
+
+static inline struct hlist_head *
+fat_dir_index_bucket(struct fat_dir_index *index, unsigned int name_hash)
+{
+	return &index->hash[hash_32(name_hash, index->bits)];
+}
+
+static void __fat_dir_index_free(struct fat_dir_index *index)
+{
+	struct fat_dir_index_entry *e;
+	struct hlist_node *p, *n;
+	int i;
+
+	for (i = 0; i < (1 << index->bits); i++) {
+		hlist_for_each_entry_safe(e, p, n, &index->hash[i], hash)
+			kmem_cache_free(fat_dir_index_cachep, e);
+	}
+	kfree(index);
+}
+
+void fat_dir_index_free(struct inode *dir)
+{
+	struct fat_dir_index *index = MSDOS_I(dir)->i_dir_index;
+
+	if (index) {
+		MSDOS_I(dir)->i_dir_index = NULL;
+		__fat_dir_index_free(index);
+	}
+}
+
+static int fat_dir_index_insert(struct fat_dir_index *index,
+				unsigned int name_hash, loff_t pos,
+				unsigned char nr_slots)
+{
+	struct fat_dir_index_entry *e;
+
+	e = kmem_cache_alloc(fat_dir_index_cachep, GFP_NOFS);
+	if (!e)
+		return -ENOMEM;
+	e->pos = pos;
+	e->name_hash = name_hash;
+	e->nr_slots = nr_slots;
+	hlist_add_head(&e->hash, fat_dir_index_bucket(index, name_hash));
+	return 0;
+}
+
+static void fat_dir_index_delete(struct fat_dir_index *index,
+				 unsigned int name_hash, loff_t pos)
+{
+	struct fat_dir_index_entry *e;
+	struct hlist_node *p, *n;
+
+	hlist_for_each_entry_safe(e, p, n,
+				  fat_dir_index_bucket(index, name_hash), hash) {
+		if (e->name_hash == name_hash && e->pos == pos) {
+			hlist_del(&e->hash);
+			kmem_cache_free(fat_dir_index_cachep, e);
 		}
-		if (!last_u)
+	}
+}
+
+/* Add (or delete) the names of the record at pos to (from) the index */
+static int fat_dir_index_names(struct msdos_sb_info *sbi,
+			       struct fat_dir_index *index,
+			       struct fat_record_names *rn, loff_t pos,
+			       unsigned char nr_slots, int add)
+{
+	unsigned int hash[2];
+	int i, nr = 0, err;
+
+	if (rn->short_len)
+		hash[nr++] = fat_name_hash(sbi, rn->shortname, rn->short_len);
+	if (rn->long_len) {
+		hash[nr] = fat_name_hash(sbi, rn->longname, rn->long_len);
+		if (!nr || hash[nr] != hash[0])
+			nr++;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (!add) {
+			fat_dir_index_delete(index, hash[i], pos);
 			continue;
+		}
+		err = fat_dir_index_insert(index, hash[i], pos, nr_slots);
+		if (err)
+			return err;
+	}
+	return 0;
+}
 
-		/* Compare shortname */
-		bufuname[last_u] = 0x0000;
-		len = fat_uni_to_x8(sbi, bufuname, bufname, sizeof(bufname));
-		if (fat_name_match(sbi, name, name_len, bufname, len))
-			goto found;
+static struct fat_dir_index *fat_dir_index_build(struct inode *dir)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(dir->i_sb);
+	struct fat_dir_index *index;
+	struct fat_record_names rn;
+	struct buffer_head *bh = NULL;
+	struct msdos_dir_entry *de;
+	unsigned char nr_slots;
+	unsigned char bufname[FAT_MAX_SHORT_SIZE];
+	wchar_t *unicode = NULL;
+	unsigned int bits;
+	loff_t cpos = 0;
+	int err;
 
-compare_longname:
-		if (nr_slots) {
-			void *longname = unicode + FAT_MAX_UNI_CHARS;
-			int size = PATH_MAX - FAT_MAX_UNI_SIZE;
+	bits = min(ilog2(dir->i_size / sizeof(*de)), FAT_DIR_INDEX_MAX_BITS);
+	index = kzalloc(sizeof(*index) + (sizeof(struct hlist_head) << bits),
+			GFP_NOFS);
+	if (!index)
+		return NULL;
+	index->bits = bits;
 
-			/* Compare longname */
-			len = fat_uni_to_x8(sbi, unicode, longname, size);
-			if (fat_name_match(sbi, name, name_len, longname, len))
-				goto found;
+	rn.shortname = bufname;
+	while (1) {
+		err = fat_get_record(dir, &cpos, &bh, &de, &unicode, &nr_slots);
+		if (err)
+			break;
+		if (!fat_record_names(sbi, de, unicode, nr_slots, &rn))
+			continue;
+		err = fat_dir_index_names(sbi, index, &rn,
+					  cpos - (nr_slots + 1) * sizeof(*de),
+					  nr_slots, 1);
+		if (err) {
+			brelse(bh);
+			break;
+		}
+	}
+	if (unicode)
+		__putname(unicode);
+
+	if (err != PARSE_EOF) {
+		__fat_dir_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+/*
+ * Update the index for the record at pos, which was just added or is
+ * about to be removed.
+ */
+static void fat_dir_index_update(struct inode *dir, loff_t pos, int add)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(dir->i_sb);
+	struct fat_dir_index *index = MSDOS_I(dir)->i_dir_index;
+	struct fat_record_names rn;
+	struct buffer_head *bh = NULL;
+	struct msdos_dir_entry *de;
+	unsigned char nr_slots;
+	unsigned char bufname[FAT_MAX_SHORT_SIZE];
+	wchar_t *unicode = NULL;
+	loff_t cpos = pos;
+	int err;
+
+	if (!index)
+		return;
+
+	rn.shortname = bufname;
+	err = fat_get_record(dir, &cpos, &bh, &de, &unicode, &nr_slots);
+	if (!err) {
+		if (cpos - (nr_slots + 1) * sizeof(*de) != pos)
+			err = -EIO;
+		else if (fat_record_names(sbi, de, unicode, nr_slots, &rn))
+			err = fat_dir_index_names(sbi, index, &rn, pos,
+						  nr_slots, add);
+		brelse(bh);
+	}
+	if (unicode)
+		__putname(unicode);
+
+	if (err)
+		fat_dir_index_free(dir);
+}
+
+/*
+ * Return values: negative -> error, 0 -> not found, positive -> found,
+ * value is the total amount of slots, including the shortname entry.
+ */
+int fat_search_long(struct inode *inode, const unsigned char *name,
+		    int name_len, struct fat_slot_info *sinfo)
+{
+	struct super_block *sb = inode->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct msdos_inode_info *ei = MSDOS_I(inode);
+	struct buffer_head *bh = NULL;
+	struct msdos_dir_entry *de;
+	struct fat_dir_index_entry *e;
+	struct hlist_node *p;
+	struct fat_record_names rn;
+	unsigned char nr_slots;
+	wchar_t *unicode = NULL;
+	unsigned char bufname[FAT_MAX_SHORT_SIZE];
+	unsigned int name_hash;
+	loff_t cpos = 0;
+	int err;
+
+	rn.shortname = bufname;
+
+	if (!ei->i_dir_index && inode->i_size >= FAT_DIR_INDEX_MIN_SIZE)
+		ei->i_dir_index = fat_dir_index_build(inode);
+	if (!ei->i_dir_index)
+		goto linear;
+
+	name_hash = fat_name_hash(sbi, name, name_len);
+	hlist_for_each_entry(e, p,
+			     fat_dir_index_bucket(ei->i_dir_index, name_hash),
+			     hash) {
+		if (e->name_hash != name_hash)
+			continue;
+
+		brelse(bh);
+		bh = NULL;
+		de = NULL;
+		cpos = e->pos;
+		err = fat_get_record(inode, &cpos, &bh, &de, &unicode,
+				     &nr_slots);
+		if (err < 0)
+			goto end_of_dir;
+		if (err || nr_slots != e->nr_slots ||
+		    cpos - (nr_slots + 1) * sizeof(*de) != e->pos) {
+			/* Out of date, don't trust it */
+			brelse(bh);
+			bh = NULL;
+			fat_dir_index_free(inode);
+			cpos = 0;
+			goto linear;
 		}
+		if (fat_record_names(sbi, de, unicode, nr_slots, &rn) &&
+		    fat_record_match(sbi, name, name_len, &rn))
+			goto found;
+	}
+	brelse(bh);
+	err = -ENOENT;
+	goto end_of_dir;
+
+linear:
+	while (1) {
+		err = fat_get_record(inode, &cpos, &bh, &de, &unicode,
+				     &nr_slots);
+		if (err) {
+			if (err == PARSE_EOF)
+				err = -ENOENT;
+			goto end_of_dir;
+		}
+		if (fat_record_names(sbi, de, unicode, nr_slots, &rn) &&
+		    fat_record_match(sbi, name, name_len, &rn))
+			goto found;
 	}
 
 found:
@@ -1001,6 +1337,8 @@ int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo)
 	struct buffer_head *bh;
 	int err = 0, nr_slots;
 
+	fat_dir_index_update(dir, sinfo->slot_off, 0);
+
 	/*
 	 * First stage: Remove the shortname. By this, the directory
 	 * entry is removed.
@@ -1360,6 +1698,8 @@ found:
 	sinfo->bh = bh;
 	sinfo->i_pos = fat_make_i_pos(sb, sinfo->bh, sinfo->de);
 
+	fat_dir_index_update(dir, pos, 1);
+
 	return 0;
 
 error:
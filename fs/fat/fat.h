@@ -87,6 +87,8 @@ struct msdos_sb_info {
 
 #define FAT_CACHE_VALID	0	/* special case for valid cache */
 
+struct fat_dir_index;
+
 /*
  * MS-DOS file system inode data in memory
  */
@@ -105,6 +107,7 @@ struct msdos_inode_info {
 	int i_attrs;		/* unused attribute bits */
 	loff_t i_pos;		/* on-disk position of directory entry or 0 */
 	struct hlist_node i_fat_hash;	/* hash by i_location */
+	struct fat_dir_index *i_dir_index; /* name index of a directory */
 	struct inode vfs_inode;
 };
 
@@ -246,6 +249,7 @@ extern int fat_alloc_new_dir(struct inode *dir, struct timespec *ts);
 extern int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 			   struct fat_slot_info *sinfo);
 extern int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo);
+extern void fat_dir_index_free(struct inode *dir);
 
 /* fat/fatent.c */
 struct fat_entry {
@@ -333,6 +337,8 @@ extern int fat_sync_bhs(struct buffer_head **bhs, int nr_bhs);
 
 int fat_cache_init(void);
 void fat_cache_destroy(void);
+int fat_dir_index_init(void);
+void fat_dir_index_destroy(void);
 
 /* helper for printk */
 typedef unsigned long long	llu;
@@ -436,6 +436,7 @@ static void fat_delete_inode(struct inode *inode)
 static void fat_clear_inode(struct inode *inode)
 {
 	fat_cache_inval_inode(inode);
+	fat_dir_index_free(inode);
 	fat_detach(inode);
 }
 
@@ -494,6 +495,7 @@ static struct inode *fat_alloc_inode(struct super_block *sb)
 	ei = kmem_cache_alloc(fat_inode_cachep, GFP_NOFS);
 	if (!ei)
 		return NULL;
+	ei->i_dir_index = NULL;
 	return &ei->vfs_inode;
 }
 
@@ -1557,12 +1559,18 @@ static int __init init_fat_fs(void)
 	if (err)
 		return err;
 
-	err = fat_init_inodecache();
+	err = fat_dir_index_init();
 	if (err)
 		goto failed;
 
+	err = fat_init_inodecache();
+	if (err)
+		goto failed_dir_index;
+
 	return 0;
 
+failed_dir_index:
+	fat_dir_index_destroy();
 failed:
 	fat_cache_destroy();
 	return err;
@@ -1571,6 +1579,7 @@ failed:
 static void __exit exit_fat_fs(void)
 {
 	fat_cache_destroy();
+	fat_dir_index_destroy();
 	fat_destroy_inodecache();
 }
 
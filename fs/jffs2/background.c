@@ -91,7 +91,12 @@ static int jffs2_garbage_collect_thread(void *_c)
 			set_current_state (TASK_INTERRUPTIBLE);
 			spin_unlock(&c->erase_completion_lock);
 			D1(printk(KERN_DEBUG "jffs2_garbage_collect_thread sleeping...\n"));
-			schedule();
+			if (!schedule_timeout(jffs2_checkpoint_timeout(c)) &&
+			    !signal_pending(current) && !kthread_should_stop()) {
+				/* Nothing to collect; just time for a checkpoint */
+				jffs2_checkpoint_periodic(c);
+				goto again;
+			}
 		} else
 			spin_unlock(&c->erase_completion_lock);
 			
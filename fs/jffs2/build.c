@@ -113,9 +113,11 @@ static int jffs2_build_filesystem(struct jffs2_sb_info *c)
 
 	dbg_fsbuild("pass 1 starting\n");
 	c->flags |= JFFS2_SB_FLAG_BUILDING;
-	/* Now scan the directory tree, increasing nlink according to every dirent found. */
+	/* Now scan the directory tree, increasing nlink according to every dirent found.
+	   A checkpoint already carries the link counts of all inodes, and
+	   only the dirents in the blocks it did not cover have been seen. */
 	for_each_inode(i, c, ic) {
-		if (ic->scan_dents) {
+		if (ic->scan_dents && !(c->flags & JFFS2_SB_FLAG_CHECKPOINT)) {
 			jffs2_build_inode_pass1(c, ic);
 			cond_resched();
 		}
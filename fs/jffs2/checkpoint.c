@@ -0,0 +1,994 @@
+/*
+ * JFFS2 -- Journalling Flash File System, Version 2.
+ *
+ * Checkpointed mount.
+ *
+ * For licensing information, see the file 'LICENCE' in this directory.
+ *
+ */
+
+/*
+ * A checkpoint is a copy of the node lists of every eraseblock whose
+ * contents are settled (clean, dirty and free blocks), together with the
+ * link counts of all inodes. It is written into free eraseblocks as one
+ * head node followed by a chain of data nodes. The head node is of a
+ * ROCOMPAT type: a kernel without checkpoint support would write to
+ * blocks the checkpoint lists as free without invalidating it, so it may
+ * only mount the filesystem read-only. Kernels built without
+ * CONFIG_JFFS2_CHECKPOINT invalidate any checkpoint they find when
+ * mounting read-write, see jffs2_scan_checkpoint_node().
+ *
+ * At mount the head node with the highest sequence number is looked for
+ * at the start of every eraseblock. If it is valid, the blocks it
+ * describes are rebuilt from it and only the remaining ones are
+ * scanned. Anything that does not check out falls back to the full scan.
+ *
+ * Behind the head node an aligned slot is left erased. The first change
+ * to the flash after a checkpoint was written or used overwrites the
+ * slot, so a checkpoint is never trusted for a medium it no longer
+ * describes. See jffs2_checkpoint_modify().
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/vmalloc.h>
+#include <linux/mtd/mtd.h>
+#include <linux/crc32.h>
+#include <linux/sort.h>
+#include <linux/sched.h>
+#include <linux/jiffies.h>
+#include <linux/moduleparam.h>
+#include "nodelist.h"
+
+static unsigned int checkpoint_interval = CONFIG_JFFS2_CHECKPOINT_INTERVAL;
+module_param(checkpoint_interval, uint, 0644);
+MODULE_PARM_DESC(checkpoint_interval,
+		 "Seconds after a change before the checkpoint is rewritten (0 = only at unmount)");
+
+#define CKPT_NO_RECORD	0xffffffff
+
+/* The checkpoint being restored at mount */
+struct jffs2_checkpoint {
+	jint32_t *data;		/* all records */
+	uint32_t *index;	/* per eraseblock: word offset of its record */
+};
+
+/* Owner of a node, for looking up the inode of a raw node ref */
+struct jffs2_ckpt_owner {
+	uint32_t ofs;
+	uint32_t ino;
+};
+
+static inline uint32_t jffs2_ckpt_node_ofs(struct jffs2_sb_info *c)
+{
+	return roundup(c->cleanmarker_size, jffs2_ckpt_align(c));
+}
+
+/* Bytes of records that fit into one data node */
+static inline uint32_t jffs2_ckpt_data_cap(struct jffs2_sb_info *c)
+{
+	return (c->sector_size - jffs2_ckpt_node_ofs(c) -
+		sizeof(struct jffs2_unknown_node)) & ~3;
+}
+
+static inline unsigned long jffs2_ckpt_interval(void)
+{
+	return checkpoint_interval * HZ;
+}
+
+void jffs2_checkpoint_init(struct jffs2_sb_info *c)
+{
+	mutex_init(&c->ckpt_mutex);
+	c->ckpt_due = jiffies + jffs2_ckpt_interval();
+}
+
+int jffs2_checkpoint_modify(struct jffs2_sb_info *c)
+{
+	uint32_t len = jffs2_ckpt_align(c);
+	unsigned char *buf;
+	size_t retlen;
+	int ret = 0;
+
+	mutex_lock(&c->ckpt_mutex);
+	if (!c->ckpt_slot)
+		goto out;
+
+	buf = kzalloc(len, GFP_KERNEL);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	ret = c->mtd->write(c->mtd, c->ckpt_slot, len, &retlen, buf);
+	if (!ret && retlen != len)
+		ret = -EIO;
+	kfree(buf);
+	if (ret) {
+		/* Leave it live, so that we try again next time */
+		JFFS2_ERROR("cannot invalidate checkpoint %u at %#08x: %d\n",
+			    c->ckpt_seqno, c->ckpt_slot, ret);
+		goto out;
+	}
+
+	D1(printk(KERN_DEBUG "jffs2_checkpoint_modify(): checkpoint %u invalidated\n",
+		  c->ckpt_seqno));
+	c->ckpt_slot = 0;
+	c->ckpt_due = jiffies + jffs2_ckpt_interval();
+ out:
+	mutex_unlock(&c->ckpt_mutex);
+	return ret;
+}
+
+/* Read and check the head node at ofs. rc has room for max_len bytes */
+static int jffs2_ckpt_read_head(struct jffs2_sb_info *c, uint32_t ofs,
+				struct jffs2_raw_checkpoint *rc, uint32_t max_len)
+{
+	uint32_t totlen, crc;
+	size_t retlen;
+	int ret;
+
+	ret = jffs2_flash_read(c, ofs, sizeof(*rc), &retlen, (unsigned char *)rc);
+	if (ret || retlen != sizeof(*rc))
+		return -EIO;
+
+	if (je16_to_cpu(rc->magic) != JFFS2_MAGIC_BITMASK ||
+	    je16_to_cpu(rc->nodetype) != JFFS2_NODETYPE_CHECKPOINT)
+		return -ENOENT;
+
+	crc = crc32(0, rc, sizeof(struct jffs2_unknown_node) - 4);
+	if (crc != je32_to_cpu(rc->hdr_crc))
+		return -EINVAL;
+
+	totlen = je32_to_cpu(rc->totlen);
+	if (totlen < sizeof(*rc) || totlen > max_len ||
+	    totlen - sizeof(*rc) != je32_to_cpu(rc->nr_chain) * 4)
+		return -EINVAL;
+
+	ret = jffs2_flash_read(c, ofs + sizeof(*rc), totlen - sizeof(*rc),
+			       &retlen, (unsigned char *)rc->chain);
+	if (ret || retlen != totlen - sizeof(*rc))
+		return -EIO;
+
+	crc = crc32(0, rc, sizeof(*rc) - 4);
+	crc = crc32(crc, rc->chain, totlen - sizeof(*rc));
+	if (crc != je32_to_cpu(rc->node_crc))
+		return -EINVAL;
+
+	return 0;
+}
+
+/* A checkpoint is valid for as long as its slot is still erased */
+static int jffs2_ckpt_slot_erased(struct jffs2_sb_info *c,
+				  struct jffs2_eraseblock *jeb,
+				  struct jffs2_raw_checkpoint *rc)
+{
+	uint32_t slot = je32_to_cpu(rc->slot);
+	uint32_t marker;
+	size_t retlen;
+	int ret;
+
+	if (slot < jeb->offset + jffs2_ckpt_node_ofs(c) + je32_to_cpu(rc->totlen) ||
+	    slot + jffs2_ckpt_align(c) > jeb->offset + c->sector_size)
+		return 0;
+
+	ret = jffs2_flash_read(c, slot, sizeof(marker), &retlen,
+			       (unsigned char *)&marker);
+	if (ret || retlen != sizeof(marker))
+		return 0;
+
+	return marker == 0xffffffff;
+}
+
+/* Find the live checkpoint with the highest sequence number */
+static struct jffs2_raw_checkpoint *jffs2_ckpt_find(struct jffs2_sb_info *c,
+						    uint32_t *slot)
+{
+	struct jffs2_raw_checkpoint *rc, *best = NULL;
+	uint32_t max_len = sizeof(*rc) + c->nr_blocks * 4;
+	uint32_t node_ofs = jffs2_ckpt_node_ofs(c);
+	int i;
+
+	rc = kmalloc(max_len, GFP_KERNEL);
+	if (!rc)
+		return NULL;
+
+	for (i = 0; i < c->nr_blocks; i++) {
+		struct jffs2_eraseblock *jeb = &c->blocks[i];
+		uint32_t seqno;
+
+		cond_resched();
+
+		if (jffs2_ckpt_read_head(c, jeb->offset + node_ofs, rc, max_len))
+			continue;
+
+		seqno = je32_to_cpu(rc->seqno);
+		if (seqno > c->ckpt_seqno)
+			c->ckpt_seqno = seqno;
+
+		if (best && seqno <= je32_to_cpu(best->seqno))
+			continue;
+
+		if (!jffs2_ckpt_slot_erased(c, jeb, rc)) {
+			D1(printk(KERN_DEBUG "jffs2_ckpt_find(): checkpoint %u at 0x%08x was invalidated\n",
+				  seqno, jeb->offset));
+			continue;
+		}
+
+		*slot = je32_to_cpu(rc->slot);
+		if (!best) {
+			best = rc;
+			rc = kmalloc(max_len, GFP_KERNEL);
+			if (!rc)
+				break;
+		} else {
+			swap(best, rc);
+		}
+	}
+
+	kfree(rc);
+	return best;
+}
+
+/* Read the data nodes of the checkpoint back into one buffer */
+static jint32_t *jffs2_ckpt_read_data(struct jffs2_sb_info *c,
+				      struct jffs2_raw_checkpoint *rc)
+{
+	uint32_t data_len = je32_to_cpu(rc->data_len);
+	uint32_t nr_chain = je32_to_cpu(rc->nr_chain);
+	uint32_t node_ofs = jffs2_ckpt_node_ofs(c);
+	uint32_t cap = jffs2_ckpt_data_cap(c);
+	uint32_t done = 0, i;
+	unsigned char *data;
+
+	if (!data_len || data_len % 4 || data_len > nr_chain * cap)
+		return NULL;
+
+	data = vmalloc(data_len);
+	if (!data)
+		return NULL;
+
+	for (i = 0; i < nr_chain; i++) {
+		uint32_t blk = je32_to_cpu(rc->chain[i]);
+		struct jffs2_unknown_node n;
+		uint32_t ofs, len;
+		size_t retlen;
+		int ret;
+
+		if (blk >= c->nr_blocks)
+			goto bad;
+		ofs = c->blocks[blk].offset + node_ofs;
+
+		ret = jffs2_flash_read(c, ofs, sizeof(n), &retlen, (unsigned char *)&n);
+		if (ret || retlen != sizeof(n))
+			goto bad;
+		if (je16_to_cpu(n.magic) != JFFS2_MAGIC_BITMASK ||
+		    je16_to_cpu(n.nodetype) != JFFS2_NODETYPE_CHECKPOINT_DATA ||
+		    crc32(0, &n, sizeof(n) - 4) != je32_to_cpu(n.hdr_crc) ||
+		    je32_to_cpu(n.totlen) < sizeof(n))
+			goto bad;
+
+		len = je32_to_cpu(n.totlen) - sizeof(n);
+		if (len > cap || len > data_len - done)
+			goto bad;
+
+		ret = jffs2_flash_read(c, ofs + sizeof(n), len, &retlen, data + done);
+		if (ret || retlen != len)
+			goto bad;
+		done += len;
+	}
+
+	if (done != data_len || crc32(0, data, data_len) != je32_to_cpu(rc->data_crc))
+		goto bad;
+
+	return (jint32_t *)data;
+ bad:
+	vfree(data);
+	return NULL;
+}
+
+/* Check the eraseblock records and index them. Inode numbers are
+   checked by jffs2_ckpt_check_owners() once the caches exist. */
+static int jffs2_ckpt_index(struct jffs2_sb_info *c,
+			    struct jffs2_raw_checkpoint *rc,
+			    struct jffs2_checkpoint *ckpt)
+{
+	uint32_t words = je32_to_cpu(rc->data_len) / 4;
+	uint32_t nr_blocks = je32_to_cpu(rc->nr_blocks);
+	uint32_t nr_refs = 0, pos, i;
+	jint32_t *data = ckpt->data;
+
+	pos = je32_to_cpu(rc->nr_inodes) * JFFS2_CKPT_INODE_WORDS;
+	if (pos > words)
+		return -EINVAL;
+
+	for (i = 0; i < c->nr_blocks; i++)
+		ckpt->index[i] = CKPT_NO_RECORD;
+
+	for (i = 0; i < nr_blocks; i++) {
+		uint32_t blk, nr, end, prev = 0, j;
+
+		if (words - pos < JFFS2_CKPT_BLOCK_WORDS)
+			return -EINVAL;
+		blk = je32_to_cpu(data[pos]);
+		nr = je32_to_cpu(data[pos + 1]);
+		end = je32_to_cpu(data[pos + 2]);
+
+		if (blk >= c->nr_blocks || ckpt->index[blk] != CKPT_NO_RECORD ||
+		    end > c->sector_size || (!nr && end) ||
+		    nr > (words - pos - JFFS2_CKPT_BLOCK_WORDS) / JFFS2_CKPT_REF_WORDS)
+			return -EINVAL;
+
+		ckpt->index[blk] = pos;
+		pos += JFFS2_CKPT_BLOCK_WORDS;
+
+		/* Nodes must tile the block from its start up to end */
+		for (j = 0; j < nr; j++, pos += JFFS2_CKPT_REF_WORDS) {
+			uint32_t ofs = je32_to_cpu(data[pos]) & ~3;
+
+			if ((j ? ofs <= prev : ofs != 0) || ofs >= end)
+				return -EINVAL;
+			prev = ofs;
+		}
+		nr_refs += nr;
+	}
+
+	if (pos != words || nr_refs != je32_to_cpu(rc->nr_refs))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int jffs2_ckpt_check_owners(struct jffs2_sb_info *c,
+				   struct jffs2_checkpoint *ckpt)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < c->nr_blocks; i++) {
+		jint32_t *rec;
+		uint32_t nr;
+
+		if (ckpt->index[i] == CKPT_NO_RECORD)
+			continue;
+
+		rec = ckpt->data + ckpt->index[i];
+		nr = je32_to_cpu(rec[1]);
+		rec += JFFS2_CKPT_BLOCK_WORDS;
+		for (j = 0; j < nr; j++, rec += JFFS2_CKPT_REF_WORDS) {
+			uint32_t ino = je32_to_cpu(rec[1]);
+
+			if ((je32_to_cpu(rec[0]) & 3) == REF_OBSOLETE || !ino)
+				continue;
+			if (!jffs2_get_ino_cache(c, ino))
+				return -EINVAL;
+		}
+		cond_resched();
+	}
+	return 0;
+}
+
+static int jffs2_ckpt_make_inodes(struct jffs2_sb_info *c,
+				  struct jffs2_raw_checkpoint *rc,
+				  struct jffs2_checkpoint *ckpt)
+{
+	uint32_t nr_inodes = je32_to_cpu(rc->nr_inodes);
+	jint32_t *rec = ckpt->data;
+	uint32_t i;
+
+	for (i = 0; i < nr_inodes; i++, rec += JFFS2_CKPT_INODE_WORDS) {
+		struct jffs2_inode_cache *ic;
+		uint32_t ino = je32_to_cpu(rec[0]);
+
+		if (!ino || jffs2_get_ino_cache(c, ino))
+			return -EINVAL;
+
+		ic = jffs2_scan_make_ino_cache(c, ino);
+		if (!ic)
+			return -ENOMEM;
+		ic->pino_nlink = je32_to_cpu(rec[1]);
+	}
+
+	if (je32_to_cpu(rc->highest_ino) > c->highest_ino)
+		c->highest_ino = je32_to_cpu(rc->highest_ino);
+
+	return 0;
+}
+
+static int jffs2_ckpt_use(struct jffs2_sb_info *c,
+			  struct jffs2_raw_checkpoint *rc)
+{
+	struct jffs2_checkpoint *ckpt;
+	int ret = -EINVAL;
+
+	if (je32_to_cpu(rc->flash_size) != c->flash_size ||
+	    je32_to_cpu(rc->sector_size) != c->sector_size ||
+	    je32_to_cpu(rc->cln_mkr) != c->cleanmarker_size)
+		return -EINVAL;
+
+	ckpt = kzalloc(sizeof(*ckpt), GFP_KERNEL);
+	if (!ckpt)
+		return -ENOMEM;
+
+	ckpt->index = vmalloc(c->nr_blocks * sizeof(uint32_t));
+	if (!ckpt->index) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	ckpt->data = jffs2_ckpt_read_data(c, rc);
+	if (!ckpt->data)
+		goto out_free;
+
+	ret = jffs2_ckpt_index(c, rc, ckpt);
+	if (ret)
+		goto out_free;
+
+	ret = jffs2_ckpt_make_inodes(c, rc, ckpt);
+	if (!ret)
+		ret = jffs2_ckpt_check_owners(c, ckpt);
+	if (ret) {
+		jffs2_free_ino_caches(c);
+		c->highest_ino = 1;
+		goto out_free;
+	}
+
+	c->ckpt = ckpt;
+	return 0;
+
+ out_free:
+	vfree(ckpt->data);
+	vfree(ckpt->index);
+	kfree(ckpt);
+	return ret;
+}
+
+void jffs2_checkpoint_load(struct jffs2_sb_info *c)
+{
+	struct jffs2_raw_checkpoint *rc;
+	uint32_t slot = 0;
+	int ret;
+
+	rc = jffs2_ckpt_find(c, &slot);
+	if (!rc)
+		return;
+
+	ret = jffs2_ckpt_use(c, rc);
+	if (ret) {
+		JFFS2_NOTICE("checkpoint %u is unusable (%d), scanning the whole medium\n",
+			     je32_to_cpu(rc->seqno), ret);
+	} else {
+		JFFS2_NOTICE("using checkpoint %u for %u of %u eraseblocks\n",
+			     je32_to_cpu(rc->seqno), je32_to_cpu(rc->nr_blocks),
+			     c->nr_blocks);
+		c->flags |= JFFS2_SB_FLAG_CHECKPOINT;
+		c->ckpt_slot = slot;
+	}
+	kfree(rc);
+}
+
+/* Rebuild the node list of jeb from the checkpoint. Returns the state
+   of the block as jffs2_scan_eraseblock() would, or 0 if the block is
+   not covered by the checkpoint and has to be scanned. */
+int jffs2_checkpoint_restore_block(struct jffs2_sb_info *c,
+				   struct jffs2_eraseblock *jeb,
+				   uint32_t *pseudo_random)
+{
+	struct jffs2_checkpoint *ckpt = c->ckpt;
+	uint32_t nr, end, i;
+	jint32_t *rec;
+	int ret;
+
+	if (!ckpt || ckpt->index[jeb - c->blocks] == CKPT_NO_RECORD)
+		return 0;
+
+	rec = ckpt->data + ckpt->index[jeb - c->blocks];
+	nr = je32_to_cpu(rec[1]);
+	end = je32_to_cpu(rec[2]);
+	rec += JFFS2_CKPT_BLOCK_WORDS;
+
+	if (nr) {
+		ret = jffs2_prealloc_raw_node_refs(c, jeb, nr);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < nr; i++, rec += JFFS2_CKPT_REF_WORDS) {
+		uint32_t ofs = je32_to_cpu(rec[0]);
+		uint32_t ino = je32_to_cpu(rec[1]);
+		uint32_t next = end;
+		struct jffs2_inode_cache *ic = NULL;
+
+		if (i + 1 < nr)
+			next = je32_to_cpu(rec[JFFS2_CKPT_REF_WORDS]) & ~3;
+
+		/* Like after a scan, the CRCs of inode nodes and dirents are
+		   left to be checked in the background */
+		if ((ofs & 3) != REF_OBSOLETE && ino) {
+			ic = jffs2_get_ino_cache(c, ino);
+			ofs = (ofs & ~3) | REF_UNCHECKED;
+		}
+
+		jffs2_link_node_ref(c, jeb, jeb->offset + ofs,
+				    next - (ofs & ~3), ic);
+		*pseudo_random += ofs;
+	}
+
+	return jffs2_scan_classify_jeb(c, jeb);
+}
+
+void jffs2_checkpoint_release(struct jffs2_sb_info *c)
+{
+	struct jffs2_checkpoint *ckpt = c->ckpt;
+
+	if (!ckpt)
+		return;
+
+	c->ckpt = NULL;
+	vfree(ckpt->data);
+	vfree(ckpt->index);
+	kfree(ckpt);
+}
+
+/*
+ * Writing the checkpoint.
+ */
+
+/* Blocks taken off the free list to hold the checkpoint */
+struct jffs2_ckpt_blocks {
+	int nr;
+	struct jffs2_eraseblock *jeb[0];
+};
+
+/* Blocks on these lists are only written to again after being erased.
+   The nextblock is left to be scanned, so that it can become the
+   nextblock again together with its summary. */
+#define for_each_listed_block(c, jeb, i, lists)			\
+	for (i = 0; i < ARRAY_SIZE(lists); i++)				\
+		list_for_each_entry(jeb, lists[i], list)
+
+static uint32_t jffs2_ckpt_nr_refs(struct jffs2_eraseblock *jeb)
+{
+	struct jffs2_raw_node_ref *ref;
+	uint32_t nr = 0;
+
+	for (ref = jeb->first_node; ref; ref = ref_next(ref))
+		nr++;
+	return nr;
+}
+
+static int jffs2_ckpt_owner_cmp(const void *a, const void *b)
+{
+	const struct jffs2_ckpt_owner *x = a, *y = b;
+
+	if (x->ofs < y->ofs)
+		return -1;
+	return x->ofs > y->ofs;
+}
+
+static uint32_t jffs2_ckpt_owner(struct jffs2_ckpt_owner *owners,
+				 uint32_t nr, uint32_t ofs)
+{
+	uint32_t lo = 0, hi = nr;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (owners[mid].ofs == ofs)
+			return owners[mid].ino;
+		if (owners[mid].ofs < ofs)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return 0;
+}
+
+/* Encode the node list of jeb at data[*pos]. Nodes belonging to
+   anything but an inode (xattrs) make us give up. */
+static int jffs2_ckpt_encode_block(struct jffs2_sb_info *c,
+				   struct jffs2_eraseblock *jeb,
+				   struct jffs2_ckpt_owner *owners,
+				   uint32_t nr_owners, jint32_t *data,
+				   uint32_t *pos, uint32_t max)
+{
+	struct jffs2_raw_node_ref *ref;
+	uint32_t p = *pos + JFFS2_CKPT_BLOCK_WORDS, nr = 0;
+
+	if (p > max)
+		return -EAGAIN;
+
+	for (ref = jeb->first_node; ref; ref = ref_next(ref)) {
+		uint32_t ino = 0;
+
+		if (p + JFFS2_CKPT_REF_WORDS > max)
+			return -EAGAIN;
+
+		if (!ref_obsolete(ref) && ref->next_in_ino) {
+			ino = jffs2_ckpt_owner(owners, nr_owners, ref_offset(ref));
+			if (!ino)
+				return -EOPNOTSUPP;
+		}
+		data[p++] = cpu_to_je32((ref_offset(ref) - jeb->offset) | ref_flags(ref));
+		data[p++] = cpu_to_je32(ino);
+		nr++;
+	}
+
+	data[*pos] = cpu_to_je32(jeb - c->blocks);
+	data[*pos + 1] = cpu_to_je32(nr);
+	data[*pos + 2] = cpu_to_je32(c->sector_size - jeb->free_size);
+	*pos = p;
+	return 0;
+}
+
+static void jffs2_ckpt_put_blocks(struct jffs2_sb_info *c,
+				  struct jffs2_ckpt_blocks *cb)
+{
+	int i;
+
+	spin_lock(&c->erase_completion_lock);
+	for (i = 0; i < cb->nr; i++) {
+		list_add(&cb->jeb[i]->list, &c->free_list);
+		c->nr_free_blocks++;
+	}
+	spin_unlock(&c->erase_completion_lock);
+	kfree(cb);
+}
+
+static struct jffs2_ckpt_blocks *jffs2_ckpt_get_blocks(struct jffs2_sb_info *c,
+						       int nr)
+{
+	struct jffs2_ckpt_blocks *cb;
+	int i;
+
+	cb = kzalloc(sizeof(*cb) + nr * sizeof(cb->jeb[0]), GFP_KERNEL);
+	if (!cb)
+		return ERR_PTR(-ENOMEM);
+
+	spin_lock(&c->erase_completion_lock);
+	if (c->nr_free_blocks < c->resv_blocks_write + nr) {
+		spin_unlock(&c->erase_completion_lock);
+		kfree(cb);
+		return ERR_PTR(-ENOSPC);
+	}
+	for (cb->nr = 0; cb->nr < nr; cb->nr++) {
+		struct jffs2_eraseblock *jeb;
+
+		jeb = list_entry(c->free_list.next, struct jffs2_eraseblock, list);
+		list_del(&jeb->list);
+		c->nr_free_blocks--;
+		cb->jeb[cb->nr] = jeb;
+	}
+	spin_unlock(&c->erase_completion_lock);
+
+	/* One ref each to account the rest of the block as dirty */
+	for (i = 0; i < nr; i++) {
+		if (jffs2_prealloc_raw_node_refs(c, cb->jeb[i], 1)) {
+			jffs2_ckpt_put_blocks(c, cb);
+			return ERR_PTR(-ENOMEM);
+		}
+	}
+	return cb;
+}
+
+/* Once written to, checkpoint blocks are just dirty space to be
+   reclaimed by the GC. They go on the dirty list rather than the very
+   dirty one so that they do not wake the GC by themselves. */
+static void jffs2_ckpt_file_blocks(struct jffs2_sb_info *c,
+				   struct jffs2_ckpt_blocks *cb)
+{
+	int i;
+
+	spin_lock(&c->erase_completion_lock);
+	for (i = 0; i < cb->nr; i++) {
+		struct jffs2_eraseblock *jeb = cb->jeb[i];
+
+		jffs2_link_node_ref(c, jeb,
+				    (jeb->offset + c->sector_size - jeb->free_size) | REF_OBSOLETE,
+				    jeb->free_size, NULL);
+		list_add_tail(&jeb->list, &c->dirty_list);
+	}
+	spin_unlock(&c->erase_completion_lock);
+	kfree(cb);
+}
+
+static int jffs2_ckpt_write_node(struct jffs2_sb_info *c, uint32_t ofs,
+				 unsigned char *buf, uint32_t totlen)
+{
+	uint32_t len = roundup(totlen, jffs2_ckpt_align(c));
+	size_t retlen;
+	int ret;
+
+	memset(buf + totlen, 0xff, len - totlen);
+	ret = c->mtd->write(c->mtd, ofs, len, &retlen, buf);
+	if (!ret && retlen != len)
+		ret = -EIO;
+	if (ret)
+		JFFS2_WARNING("checkpoint write at %#08x failed: %d\n", ofs, ret);
+	return ret;
+}
+
+/* Write the records as data nodes, then the head node pointing to them */
+static int jffs2_ckpt_write_nodes(struct jffs2_sb_info *c,
+				  struct jffs2_raw_checkpoint *head,
+				  struct jffs2_ckpt_blocks *cb,
+				  jint32_t *data, uint32_t data_len)
+{
+	uint32_t node_ofs = jffs2_ckpt_node_ofs(c);
+	uint32_t cap = jffs2_ckpt_data_cap(c);
+	uint32_t nr_chain = cb->nr - 1;
+	uint32_t totlen = sizeof(*head) + nr_chain * 4;
+	struct jffs2_raw_checkpoint *rc;
+	uint32_t done = 0, slot, crc;
+	unsigned char *buf;
+	int i, ret = 0;
+
+	slot = cb->jeb[0]->offset + roundup(node_ofs + totlen, jffs2_ckpt_align(c));
+	if (slot + jffs2_ckpt_align(c) > cb->jeb[0]->offset + c->sector_size)
+		return -ENOSPC;
+
+	buf = vmalloc(c->sector_size);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 1; i < cb->nr; i++) {
+		struct jffs2_unknown_node *n = (void *)buf;
+		uint32_t len = min(cap, data_len - done);
+
+		n->magic = cpu_to_je16(JFFS2_MAGIC_BITMASK);
+		n->nodetype = cpu_to_je16(JFFS2_NODETYPE_CHECKPOINT_DATA);
+		n->totlen = cpu_to_je32(sizeof(*n) + len);
+		n->hdr_crc = cpu_to_je32(crc32(0, n, sizeof(*n) - 4));
+		memcpy(n + 1, (unsigned char *)data + done, len);
+		done += len;
+
+		ret = jffs2_ckpt_write_node(c, cb->jeb[i]->offset + node_ofs,
+					    buf, sizeof(*n) + len);
+		if (ret)
+			goto out;
+	}
+
+	rc = (void *)buf;
+	*rc = *head;
+	rc->magic = cpu_to_je16(JFFS2_MAGIC_BITMASK);
+	rc->nodetype = cpu_to_je16(JFFS2_NODETYPE_CHECKPOINT);
+	rc->totlen = cpu_to_je32(totlen);
+	rc->hdr_crc = cpu_to_je32(crc32(0, rc, sizeof(struct jffs2_unknown_node) - 4));
+	rc->data_len = cpu_to_je32(data_len);
+	rc->data_crc = cpu_to_je32(crc32(0, data, data_len));
+	rc->slot = cpu_to_je32(slot);
+	rc->nr_chain = cpu_to_je32(nr_chain);
+	for (i = 1; i < cb->nr; i++)
+		rc->chain[i - 1] = cpu_to_je32(cb->jeb[i] - c->blocks);
+	crc = crc32(0, rc, sizeof(*rc) - 4);
+	rc->node_crc = cpu_to_je32(crc32(crc, rc->chain, nr_chain * 4));
+
+	ret = jffs2_ckpt_write_node(c, cb->jeb[0]->offset + node_ofs, buf, totlen);
+	if (!ret)
+		c->ckpt_slot = slot;
+ out:
+	vfree(buf);
+	return ret;
+}
+
+/* Called with alloc_sem and ckpt_mutex held */
+static int jffs2_do_write_checkpoint(struct jffs2_sb_info *c)
+{
+	struct list_head *lists[] = { &c->clean_list, &c->dirty_list,
+				      &c->very_dirty_list, &c->free_list };
+	struct jffs2_raw_checkpoint head;
+	struct jffs2_ckpt_owner *owners = NULL;
+	struct jffs2_ckpt_blocks *cb;
+	struct jffs2_eraseblock *jeb;
+	struct jffs2_inode_cache *ic;
+	struct jffs2_raw_node_ref *ref;
+	uint32_t nr_ic = 0, max_owners = 0, nr_owners = 0;
+	uint32_t nr_listed = 0, nr_refs = 0, nr_inodes = 0;
+	uint32_t cap = jffs2_ckpt_data_cap(c);
+	uint32_t words, max, pos = 0, nr_chain, i;
+	jint32_t *data = NULL;
+	int ret;
+
+	/* Size everything up first */
+	spin_lock(&c->erase_completion_lock);
+	spin_lock(&c->inocache_lock);
+	for (i = 0; i < INOCACHE_HASHSIZE; i++) {
+		for (ic = c->inocache_list[i]; ic; ic = ic->next) {
+			nr_ic++;
+			for (ref = ic->nodes; ref != (void *)ic; ref = ref->next_in_ino)
+				max_owners++;
+		}
+	}
+	spin_unlock(&c->inocache_lock);
+	for_each_listed_block(c, jeb, i, lists) {
+		nr_listed++;
+		nr_refs += jffs2_ckpt_nr_refs(jeb);
+	}
+	if (c->gcblock) {
+		nr_listed++;
+		nr_refs += jffs2_ckpt_nr_refs(c->gcblock);
+	}
+	spin_unlock(&c->erase_completion_lock);
+
+	words = nr_ic * JFFS2_CKPT_INODE_WORDS +
+		nr_listed * JFFS2_CKPT_BLOCK_WORDS + nr_refs * JFFS2_CKPT_REF_WORDS;
+
+	/* The checkpoint blocks describe themselves too */
+	nr_chain = 1;
+	while (nr_chain * cap < (words + (nr_chain + 1) *
+				 (JFFS2_CKPT_BLOCK_WORDS + JFFS2_CKPT_REF_WORDS)) * 4)
+		nr_chain++;
+
+	/* Blocks may have been erased and become free meanwhile */
+	max = words + (c->nr_blocks + nr_chain + 1) *
+		(JFFS2_CKPT_BLOCK_WORDS + JFFS2_CKPT_REF_WORDS);
+
+	data = vmalloc(max * 4);
+	owners = vmalloc((max_owners + 1) * sizeof(*owners));
+	if (!data || !owners) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	cb = jffs2_ckpt_get_blocks(c, nr_chain + 1);
+	if (IS_ERR(cb)) {
+		ret = PTR_ERR(cb);
+		goto out_free;
+	}
+
+	/* Link counts, and who owns which node */
+	ret = -EAGAIN;
+	spin_lock(&c->erase_completion_lock);
+	spin_lock(&c->inocache_lock);
+	for (i = 0; i < INOCACHE_HASHSIZE; i++) {
+		for (ic = c->inocache_list[i]; ic; ic = ic->next) {
+			uint32_t first = nr_owners;
+
+			for (ref = ic->nodes; ref != (void *)ic; ref = ref->next_in_ino) {
+				if (ref_obsolete(ref))
+					continue;
+				if (nr_owners == max_owners)
+					goto out_unlock;
+				owners[nr_owners].ofs = ref_offset(ref);
+				owners[nr_owners++].ino = ic->ino;
+			}
+			if (nr_owners == first)
+				continue;
+			if (pos + JFFS2_CKPT_INODE_WORDS > max)
+				goto out_unlock;
+			data[pos++] = cpu_to_je32(ic->ino);
+			data[pos++] = cpu_to_je32(ic->pino_nlink);
+			nr_inodes++;
+		}
+	}
+	spin_unlock(&c->inocache_lock);
+	spin_unlock(&c->erase_completion_lock);
+
+	sort(owners, nr_owners, sizeof(*owners), jffs2_ckpt_owner_cmp, NULL);
+
+	/* alloc_sem keeps new nodes from being written meanwhile. Nodes
+	   only becoming obsolete does not matter. */
+	nr_listed = nr_refs = 0;
+	spin_lock(&c->erase_completion_lock);
+	for_each_listed_block(c, jeb, i, lists) {
+		ret = jffs2_ckpt_encode_block(c, jeb, owners, nr_owners,
+					      data, &pos, max);
+		if (ret)
+			goto out_unlock_ecl;
+		nr_listed++;
+	}
+	if (c->gcblock) {
+		ret = jffs2_ckpt_encode_block(c, c->gcblock, owners, nr_owners,
+					      data, &pos, max);
+		if (ret)
+			goto out_unlock_ecl;
+		nr_listed++;
+	}
+	spin_unlock(&c->erase_completion_lock);
+
+	for (i = 0; i < cb->nr; i++) {
+		if (pos + JFFS2_CKPT_BLOCK_WORDS + JFFS2_CKPT_REF_WORDS > max) {
+			ret = -EAGAIN;
+			goto out_put;
+		}
+		data[pos++] = cpu_to_je32(cb->jeb[i] - c->blocks);
+		data[pos++] = cpu_to_je32(1);
+		data[pos++] = cpu_to_je32(c->sector_size);
+		data[pos++] = cpu_to_je32(0 | REF_OBSOLETE);
+		data[pos++] = cpu_to_je32(0);
+		nr_listed++;
+	}
+
+	/* Count the node records */
+	nr_refs = (pos - nr_inodes * JFFS2_CKPT_INODE_WORDS -
+		   nr_listed * JFFS2_CKPT_BLOCK_WORDS) / JFFS2_CKPT_REF_WORDS;
+
+	if (pos * 4 > nr_chain * cap) {
+		ret = -EAGAIN;
+		goto out_put;
+	}
+
+	memset(&head, 0, sizeof(head));
+	head.seqno = cpu_to_je32(c->ckpt_seqno + 1);
+	head.flash_size = cpu_to_je32(c->flash_size);
+	head.sector_size = cpu_to_je32(c->sector_size);
+	head.cln_mkr = cpu_to_je32(c->cleanmarker_size);
+	head.highest_ino = cpu_to_je32(c->highest_ino);
+	head.nr_inodes = cpu_to_je32(nr_inodes);
+	head.nr_blocks = cpu_to_je32(nr_listed);
+	head.nr_refs = cpu_to_je32(nr_refs);
+
+	ret = jffs2_ckpt_write_nodes(c, &head, cb, data, pos * 4);
+
+	/* Whatever made it to the flash, the blocks are not free any more */
+	jffs2_ckpt_file_blocks(c, cb);
+
+	if (!ret) {
+		c->ckpt_seqno++;
+		D1(printk(KERN_DEBUG "jffs2_write_checkpoint(): checkpoint %u written to %d blocks, slot at 0x%08x\n",
+			  c->ckpt_seqno, nr_chain + 1, c->ckpt_slot));
+	}
+	goto out_free;
+
+ out_unlock:
+	spin_unlock(&c->inocache_lock);
+ out_unlock_ecl:
+	spin_unlock(&c->erase_completion_lock);
+ out_put:
+	jffs2_ckpt_put_blocks(c, cb);
+ out_free:
+	vfree(owners);
+	vfree(data);
+	return ret;
+}
+
+/*
+ * Write a checkpoint of the current state unless the one on the flash
+ * is still live. Used at unmount and periodically from the GC thread.
+ */
+int jffs2_write_checkpoint(struct jffs2_sb_info *c)
+{
+	int ret = 0;
+
+	if (jffs2_is_readonly(c))
+		return 0;
+
+	mutex_lock(&c->alloc_sem);
+	/* Nothing may be left in the wbuf to be written after the
+	   checkpoint, which would then not know about it */
+	ret = jffs2_flush_wbuf_pad(c);
+	if (ret)
+		goto out;
+
+	mutex_lock(&c->ckpt_mutex);
+	if (!c->ckpt_slot) {
+		ret = jffs2_do_write_checkpoint(c);
+		if (ret) {
+			D1(printk(KERN_DEBUG "jffs2_write_checkpoint(): no checkpoint written: %d\n", ret));
+			c->ckpt_due = jiffies + jffs2_ckpt_interval();
+		}
+	}
+	mutex_unlock(&c->ckpt_mutex);
+ out:
+	mutex_unlock(&c->alloc_sem);
+	return ret;
+}
+
+/* How long the GC thread may sleep before the next periodic checkpoint */
+signed long jffs2_checkpoint_timeout(struct jffs2_sb_info *c)
+{
+	if (!checkpoint_interval)
+		return MAX_SCHEDULE_TIMEOUT;
+	if (c->ckpt_slot)
+		return jffs2_ckpt_interval();
+	if (time_before(jiffies, c->ckpt_due))
+		return c->ckpt_due - jiffies;
+	return 1;
+}
+
+void jffs2_checkpoint_periodic(struct jffs2_sb_info *c)
+{
+	if (!checkpoint_interval || c->ckpt_slot ||
+	    time_before(jiffies, c->ckpt_due))
+		return;
+
+	jffs2_write_checkpoint(c);
+}
@@ -0,0 +1,63 @@
+/*
+ * JFFS2 -- Journalling Flash File System, Version 2.
+ *
+ * Checkpointed mount: a copy of the in-core node lists written to flash
+ * at clean unmount and periodically, so that the next mount only has to
+ * scan the eraseblocks which the checkpoint does not describe.
+ *
+ * For licensing information, see the file 'LICENCE' in this directory.
+ *
+ */
+
+#ifndef JFFS2_CHECKPOINT_H
+#define JFFS2_CHECKPOINT_H
+
+/* Checkpoint nodes and the invalidation slot are written in whole
+   flash pages */
+static inline uint32_t jffs2_ckpt_align(struct jffs2_sb_info *c)
+{
+	return max_t(uint32_t, 4, c->wbuf_pagesize);
+}
+
+#ifdef CONFIG_JFFS2_CHECKPOINT
+
+/* Records following the head node, spread over the data nodes.
+   All fields are jint32_t:
+
+   inode:	ino, pino_nlink
+   eraseblock:	block number, nr_refs, end offset,
+		followed by nr_refs node records
+   node:	offset in the block | REF_* flags, owning ino or 0 */
+#define JFFS2_CKPT_INODE_WORDS	2
+#define JFFS2_CKPT_BLOCK_WORDS	3
+#define JFFS2_CKPT_REF_WORDS	2
+
+void jffs2_checkpoint_init(struct jffs2_sb_info *c);
+void jffs2_checkpoint_load(struct jffs2_sb_info *c);
+int jffs2_checkpoint_restore_block(struct jffs2_sb_info *c,
+				   struct jffs2_eraseblock *jeb,
+				   uint32_t *pseudo_random);
+void jffs2_checkpoint_release(struct jffs2_sb_info *c);
+int jffs2_write_checkpoint(struct jffs2_sb_info *c);
+signed long jffs2_checkpoint_timeout(struct jffs2_sb_info *c);
+void jffs2_checkpoint_periodic(struct jffs2_sb_info *c);
+
+/* Must be called before anything on the flash is changed, and after
+   any in-core link count changes: a live checkpoint is invalidated so
+   that it is never used to mount a medium it no longer describes. */
+int jffs2_checkpoint_modify(struct jffs2_sb_info *c);
+
+#else				/* CHECKPOINT DISABLED */
+
+#define jffs2_checkpoint_init(a)
+#define jffs2_checkpoint_load(a)
+#define jffs2_checkpoint_restore_block(a,b,c) (0)
+#define jffs2_checkpoint_release(a)
+#define jffs2_write_checkpoint(c) ({ do{} while(0); (void)(c), 0; })
+#define jffs2_checkpoint_timeout(a) (MAX_SCHEDULE_TIMEOUT)
+#define jffs2_checkpoint_periodic(a)
+#define jffs2_checkpoint_modify(c) ({ do{} while(0); (void)(c), 0; })
+
+#endif /* CONFIG_JFFS2_CHECKPOINT */
+
+#endif /* JFFS2_CHECKPOINT_H */
@@ -285,6 +285,7 @@ static int jffs2_link (struct dentry *old_dentry, struct inode *dir_i, struct de
 		mutex_lock(&f->sem);
 		old_dentry->d_inode->i_nlink = ++f->inocache->pino_nlink;
 		mutex_unlock(&f->sem);
+		jffs2_checkpoint_modify(c);
 		d_instantiate(dentry, old_dentry->d_inode);
 		dir_i->i_mtime = dir_i->i_ctime = ITIME(now);
 		atomic_inc(&old_dentry->d_inode->i_count);
@@ -840,6 +841,7 @@ static int jffs2_rename (struct inode *old_dir_i, struct dentry *old_dentry,
 			else
 				victim_f->inocache->pino_nlink--;
 			mutex_unlock(&victim_f->sem);
+			jffs2_checkpoint_modify(c);
 		}
 	}
 
@@ -862,6 +864,7 @@ static int jffs2_rename (struct inode *old_dir_i, struct dentry *old_dentry,
 		if (f->inocache && !S_ISDIR(old_dentry->d_inode->i_mode))
 			f->inocache->pino_nlink++;
 		mutex_unlock(&f->sem);
+		jffs2_checkpoint_modify(c);
 
 		printk(KERN_NOTICE "jffs2_rename(): Link succeeded, unlink failed (err %d). You now have a hard link\n", ret);
 		/* Might as well let the VFS know */
@@ -47,9 +47,15 @@ static void jffs2_erase_block(struct jffs2_sb_info *c,
 
 	D1(printk(KERN_DEBUG "jffs2_erase_block(): erase block %#08x (range %#08x-%#08x)\n",
 				jeb->offset, jeb->offset, jeb->offset + c->sector_size));
+	if (jffs2_checkpoint_modify(c)) {
+		printk(KERN_WARNING "Cannot invalidate checkpoint before erasing block at %#08x. Refiling block for later\n",
+		       jeb->offset);
+		goto refile;
+	}
 	instr = kmalloc(sizeof(struct erase_info) + sizeof(struct erase_priv_struct), GFP_KERNEL);
 	if (!instr) {
 		printk(KERN_WARNING "kmalloc for struct erase_info in jffs2_erase_block failed. Refiling block for later\n");
+	refile:
 		mutex_lock(&c->erase_free_sem);
 		spin_lock(&c->erase_completion_lock);
 		list_move(&jeb->list, &c->erase_pending_list);
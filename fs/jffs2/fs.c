@@ -394,6 +394,8 @@ int jffs2_remount_fs (struct super_block *sb, int *flags, char *data)
 		mutex_lock(&c->alloc_sem);
 		jffs2_flush_wbuf_pad(c);
 		mutex_unlock(&c->alloc_sem);
+		if (*flags & MS_RDONLY)
+			jffs2_write_checkpoint(c);
 	}
 
 	if (!(*flags & MS_RDONLY))
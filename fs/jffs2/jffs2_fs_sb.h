@@ -25,8 +25,10 @@
 #define JFFS2_SB_FLAG_RO 1
 #define JFFS2_SB_FLAG_SCANNING 2 /* Flash scanning is in progress */
 #define JFFS2_SB_FLAG_BUILDING 4 /* File system building is in progress */
+#define JFFS2_SB_FLAG_CHECKPOINT 8 /* Node lists restored from a checkpoint */
 
 struct jffs2_inodirty;
+struct jffs2_checkpoint;
 
 /* A struct for the overall file system control.  Pointers to
    jffs2_sb_info structs are named `c' in the source code.
@@ -125,6 +127,16 @@ struct jffs2_sb_info {
 
 	struct jffs2_summary *summary;		/* Summary information */
 
+#ifdef CONFIG_JFFS2_CHECKPOINT
+	struct mutex ckpt_mutex;	/* Serialises writing the checkpoint
+					   against invalidating it */
+	uint32_t ckpt_seqno;		/* Highest checkpoint seqno seen */
+	uint32_t ckpt_slot;		/* Invalidation slot of the live
+					   checkpoint, 0 if there is none */
+	unsigned long ckpt_due;		/* Next periodic checkpoint, in jiffies */
+	struct jffs2_checkpoint *ckpt;	/* Checkpoint being restored at mount */
+#endif
+
 #ifdef CONFIG_JFFS2_FS_XATTR
 #define XATTRINDEX_HASHSIZE	(57)
 	uint32_t highest_xid;
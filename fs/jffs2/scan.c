@@ -136,6 +136,8 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 		}
 	}
 
+	jffs2_checkpoint_load(c);
+
 	for (i=0; i<c->nr_blocks; i++) {
 		struct jffs2_eraseblock *jeb = &c->blocks[i];
 
@@ -144,8 +146,10 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 		/* reset summary info for next eraseblock scan */
 		jffs2_sum_reset_collected(s);
 
-		ret = jffs2_scan_eraseblock(c, jeb, buf_size?flashbuf:(flashbuf+jeb->offset),
-						buf_size, s);
+		ret = jffs2_checkpoint_restore_block(c, jeb, &pseudo_random);
+		if (!ret)
+			ret = jffs2_scan_eraseblock(c, jeb, buf_size?flashbuf:(flashbuf+jeb->offset),
+						    buf_size, s);
 
 		if (ret < 0)
 			goto out;
@@ -254,7 +258,8 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	}
 #endif
 	if (c->nr_erasing_blocks) {
-		if ( !c->used_size && ((c->nr_free_blocks+empty_blocks+bad_blocks)!= c->nr_blocks || bad_blocks == c->nr_blocks) ) {
+		if ( !c->used_size && !(c->flags & JFFS2_SB_FLAG_CHECKPOINT) &&
+		     ((c->nr_free_blocks+empty_blocks+bad_blocks)!= c->nr_blocks || bad_blocks == c->nr_blocks) ) {
 			printk(KERN_NOTICE "Cowardly refusing to erase blocks on filesystem with no valid JFFS2 nodes\n");
 			printk(KERN_NOTICE "empty_blocks %d, bad_blocks %d, c->nr_blocks %d\n",empty_blocks,bad_blocks,c->nr_blocks);
 			ret = -EIO;
@@ -264,6 +269,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	}
 	ret = 0;
  out:
+	jffs2_checkpoint_release(c);
 	if (buf_size)
 		kfree(flashbuf);
 #ifndef __ECOS
@@ -427,6 +433,51 @@ static int jffs2_scan_xref_node(struct jffs2_sb_info *c, struct jffs2_eraseblock
 }
 #endif
 
+/* A checkpoint head found by the scan was not used for this mount: it is
+   stale, or unusable, or we were built without checkpoint support. If it
+   is still live, a read-write mount invalidates it before anything is
+   written, so that no later mount trusts it. */
+static int jffs2_scan_checkpoint_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+				      struct jffs2_raw_checkpoint *rc, uint32_t ofs)
+{
+	uint32_t totlen = je32_to_cpu(rc->totlen);
+	uint32_t slot = je32_to_cpu(rc->slot);
+	uint32_t len = jffs2_ckpt_align(c);
+	uint32_t marker;
+	unsigned char *page;
+	size_t retlen;
+	int ret;
+
+	if (jffs2_is_readonly(c) || totlen < sizeof(*rc) ||
+	    slot < ofs + totlen || slot % len ||
+	    slot + len > jeb->offset + c->sector_size)
+		goto dirty;
+
+	ret = jffs2_flash_read(c, slot, sizeof(marker), &retlen, (unsigned char *)&marker);
+	if (ret || retlen != sizeof(marker) || marker != 0xffffffff)
+		goto dirty;
+
+	printk(KERN_NOTICE "jffs2: invalidating unused checkpoint %u at 0x%08x\n",
+	       je32_to_cpu(rc->seqno), ofs);
+	page = kzalloc(len, GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+	ret = c->mtd->write(c->mtd, slot, len, &retlen, page);
+	if (!ret && retlen != len)
+		ret = -EIO;
+	kfree(page);
+	if (ret) {
+		/* Writing to the medium while it still has a live checkpoint
+		   would make the checkpoint describe the wrong contents */
+		printk(KERN_WARNING "jffs2: cannot invalidate checkpoint at 0x%08x: %d\n",
+		       ofs, ret);
+		return -EROFS;
+	}
+
+ dirty:
+	return jffs2_scan_dirty_space(c, jeb, PAD(totlen));
+}
+
 /* Called with 'buf_size == 0' if buf is in fact a pointer _directly_ into
    the flash, XIP-style */
 static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
@@ -860,6 +911,23 @@ scan_more:
 			ofs += PAD(je32_to_cpu(node->totlen));
 			break;
 
+		case JFFS2_NODETYPE_CHECKPOINT:
+			if (buf_ofs + buf_len < ofs + sizeof(struct jffs2_raw_checkpoint)) {
+				buf_len = min_t(uint32_t, buf_size, jeb->offset + c->sector_size - ofs);
+				D1(printk(KERN_DEBUG "Fewer than %zd bytes (checkpoint node) left to end of buf. Reading 0x%x at 0x%08x\n",
+					  sizeof(struct jffs2_raw_checkpoint), buf_len, ofs));
+				err = jffs2_fill_scan_buf(c, buf, ofs, buf_len);
+				if (err)
+					return err;
+				buf_ofs = ofs;
+				node = (void *)buf;
+			}
+			err = jffs2_scan_checkpoint_node(c, jeb, (void *)node, ofs);
+			if (err)
+				return err;
+			ofs += PAD(je32_to_cpu(node->totlen));
+			break;
+
 		default:
 			switch (je16_to_cpu(node->nodetype) & JFFS2_COMPAT_MASK) {
 			case JFFS2_FEATURE_ROCOMPAT:
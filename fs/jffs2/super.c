@@ -169,6 +169,7 @@ static int jffs2_fill_super(struct super_block *sb, void *data, int silent)
 	init_waitqueue_head(&c->inocache_wq);
 	spin_lock_init(&c->erase_completion_lock);
 	spin_lock_init(&c->inocache_lock);
+	jffs2_checkpoint_init(c);
 
 	sb->s_op = &jffs2_super_operations;
 	sb->s_export_op = &jffs2_export_ops;
@@ -203,6 +204,9 @@ static void jffs2_put_super (struct super_block *sb)
 	jffs2_flush_wbuf_pad(c);
 	mutex_unlock(&c->alloc_sem);
 
+	if (!(sb->s_flags & MS_RDONLY))
+		jffs2_write_checkpoint(c);
+
 	jffs2_sum_exit(c);
 
 	jffs2_free_ino_caches(c);
@@ -40,6 +40,12 @@ static inline int mtd_fake_writev(struct mtd_info *mtd, const struct kvec *vecs,
 int jffs2_flash_direct_writev(struct jffs2_sb_info *c, const struct kvec *vecs,
 			      unsigned long count, loff_t to, size_t *retlen)
 {
+	int ret;
+
+	ret = jffs2_checkpoint_modify(c);
+	if (ret)
+		return ret;
+
 	if (!jffs2_is_writebuffered(c)) {
 		if (jffs2_sum_active()) {
 			int res;
@@ -61,6 +67,11 @@ int jffs2_flash_direct_write(struct jffs2_sb_info *c, loff_t ofs, size_t len,
 			size_t *retlen, const u_char *buf)
 {
 	int ret;
+
+	ret = jffs2_checkpoint_modify(c);
+	if (ret)
+		return ret;
+
 	ret = c->mtd->write(c->mtd, ofs, len, retlen, buf);
 
 	if (jffs2_sum_active()) {
@@ -484,6 +484,35 @@ ok:
 	return security_inode_permission(inode, MAY_EXEC);
 }
 
+/*
+ * Version of exec_permission_lite() for the lockless walk, where we
+ * hold no reference on the inode.  Only the plain DAC check is done;
+ * -ECHILD means "can't tell from here", and the caller falls back to
+ * the ordinary walk, which will do the full check (->permission, ACLs,
+ * capabilities, the security module) and report the real error if any.
+ */
+static int exec_permission_rcu(struct inode *inode)
+{
+	umode_t mode = inode->i_mode;
+
+	if (inode->i_op->permission)
+		return -ECHILD;
+
+	if (current_fsuid() == inode->i_uid)
+		mode >>= 6;
+	else {
+		if (IS_POSIXACL(inode) && (mode & S_IRWXG) &&
+		    inode->i_op->check_acl)
+			return -ECHILD;
+		if (in_group_p(inode->i_gid))
+			mode >>= 3;
+	}
+
+	if (!(mode & MAY_EXEC))
+		return -ECHILD;
+	return security_inode_exec_permission_rcu(inode);
+}
+
 /*
  * This is called when everything else fails, and we actually have
  * to go to the low-level filesystem to find out what we should do..
@@ -861,6 +890,115 @@ static inline int follow_on_final(struct inode *inode, unsigned lookup_flags)
 		((lookup_flags & LOOKUP_FOLLOW) || S_ISDIR(inode->i_mode));
 }
 
+/*
+ * Lockless front end of __link_path_walk(): walk as many of the
+ * intermediate components as we can straight from the dcache under
+ * rcu_read_lock(), without touching d_count or d_lock of the dentries
+ * we pass through, and take a reference only on the one we stop at.
+ *
+ * Anything beyond a hash lookup and the plain DAC exec check stops the
+ * walk: the last component, "." and "..", ->d_hash, ->d_compare and
+ * ->d_revalidate, mountpoints, symlinks, negative or uncached entries.
+ * Every step is validated with d_seq of the child and of the parent; if
+ * the dentry we stop at has changed under us, the lockless part is
+ * thrown away and the ordinary walk starts over from nd->path.
+ *
+ * Inodes are looked at without a reference, so this is only done on
+ * filesystems which free their inodes after an RCU grace period.
+ */
+static void path_walk_rcu(const char **pname, struct nameidata *nd)
+{
+	struct dentry *parent = nd->path.dentry;
+	struct super_block *sb = parent->d_sb;
+	const char *name = *pname;
+	unsigned pseq;
+	int ok = 0;
+
+	if (nd->flags & LOOKUP_REVAL)
+		return;
+	if (sb->s_op->destroy_inode && !(sb->s_type->fs_flags & FS_RCU_INODES))
+		return;
+
+	rcu_read_lock();
+	pseq = read_seqcount_begin(&parent->d_seq);
+	for (;;) {
+		struct dentry *dentry;
+		struct inode *inode;
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+		unsigned seq;
+		const char *next;
+
+		inode = parent->d_inode;
+		if (!inode || exec_permission_rcu(inode))
+			break;
+		if (parent->d_op &&
+		    (parent->d_op->d_hash || parent->d_op->d_compare))
+			break;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+		hash = init_name_hash();
+		next = name;
+		do {
+			next++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)next;
+		} while (c && (c != '/'));
+		this.len = next - name;
+		this.hash = end_name_hash(hash);
+
+		/* leave the last component to the ordinary walk */
+		if (!c)
+			break;
+		while (*++next == '/');
+		if (!*next)
+			break;
+
+		if (name[0] == '.' &&
+		    (this.len == 1 || (this.len == 2 && name[1] == '.')))
+			break;
+
+		dentry = __d_lookup_rcu(parent, &this, &seq);
+		if (!dentry)
+			break;
+		if (dentry->d_op && dentry->d_op->d_revalidate)
+			break;
+		if (d_mountpoint(dentry))
+			break;
+		inode = dentry->d_inode;
+		if (!inode || inode->i_op->follow_link || !inode->i_op->lookup)
+			break;
+		if (read_seqcount_retry(&dentry->d_seq, seq) ||
+		    read_seqcount_retry(&parent->d_seq, pseq))
+			break;
+
+		parent = dentry;
+		pseq = seq;
+		name = next;
+	}
+
+	if (parent == nd->path.dentry) {
+		rcu_read_unlock();
+		return;
+	}
+
+	spin_lock(&parent->d_lock);
+	if (!d_unhashed(parent) && !read_seqcount_retry(&parent->d_seq, pseq)) {
+		atomic_inc(&parent->d_count);
+		ok = 1;
+	}
+	spin_unlock(&parent->d_lock);
+	rcu_read_unlock();
+
+	if (ok) {
+		dput(nd->path.dentry);
+		nd->path.dentry = parent;
+		*pname = name;
+	}
+}
+
 /*
  * Name resolution.
  * This is the basic name resolution function, turning a pathname into
@@ -881,6 +1019,8 @@ static int __link_path_walk(const char *name, struct nameidata *nd)
 	if (!*name)
 		goto return_reval;
 
+	path_walk_rcu(&name, nd);
+
 	inode = nd->path.dentry->d_inode;
 	if (nd->depth)
 		lookup_flags = LOOKUP_FOLLOW | (nd->flags & LOOKUP_CONTINUE);
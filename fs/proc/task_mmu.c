@@ -18,7 +18,7 @@
 void task_mem(struct seq_file *m, struct mm_struct *mm)
 {
 	unsigned long data, text, lib;
-	unsigned long hiwater_vm, total_vm, hiwater_rss, total_rss;
+	unsigned long hiwater_vm, total_vm, hiwater_rss, total_rss, swap;
 
 	/*
 	 * Note: to minimize their overhead, mm maintains hiwater_vm and
@@ -37,6 +37,7 @@ void task_mem(struct seq_file *m, struct mm_struct *mm)
 	data = mm->total_vm - mm->shared_vm - mm->stack_vm;
 	text = (PAGE_ALIGN(mm->end_code) - (mm->start_code & PAGE_MASK)) >> 10;
 	lib = (mm->exec_vm << (PAGE_SHIFT-10)) - text;
+	swap = get_mm_counter(mm, swap_ents);
 	seq_printf(m,
 		"VmPeak:\t%8lu kB\n"
 		"VmSize:\t%8lu kB\n"
@@ -47,7 +48,8 @@ void task_mem(struct seq_file *m, struct mm_struct *mm)
 		"VmStk:\t%8lu kB\n"
 		"VmExe:\t%8lu kB\n"
 		"VmLib:\t%8lu kB\n"
-		"VmPTE:\t%8lu kB\n",
+		"VmPTE:\t%8lu kB\n"
+		"VmSwap:\t%8lu kB\n",
 		hiwater_vm << (PAGE_SHIFT-10),
 		(total_vm - mm->reserved_vm) << (PAGE_SHIFT-10),
 		mm->locked_vm << (PAGE_SHIFT-10),
@@ -55,7 +57,8 @@ void task_mem(struct seq_file *m, struct mm_struct *mm)
 		total_rss << (PAGE_SHIFT-10),
 		data << (PAGE_SHIFT-10),
 		mm->stack_vm << (PAGE_SHIFT-10), text, lib,
-		(PTRS_PER_PTE*sizeof(pte_t)*mm->nr_ptes) >> 10);
+		(PTRS_PER_PTE*sizeof(pte_t)*mm->nr_ptes) >> 10,
+		swap << (PAGE_SHIFT-10));
 }
 
 unsigned long task_vsize(struct mm_struct *mm)
@@ -74,6 +77,35 @@ int task_statm(struct mm_struct *mm, int *shared, int *text,
 	return mm->total_vm;
 }
 
+/*
+ * A one line summary of the memory of a process, made only of counters
+ * that mm keeps up to date as it goes: unlike smaps, reading it does
+ * not walk the page tables.
+ */
+int proc_pid_memstat(struct seq_file *m, struct pid_namespace *ns,
+		     struct pid *pid, struct task_struct *task)
+{
+	unsigned long anon = 0, file = 0, swap = 0, hiwater_rss = 0;
+	unsigned long size = 0, locked = 0, ptes = 0;
+	struct mm_struct *mm = get_task_mm(task);
+
+	if (mm) {
+		anon = get_mm_counter(mm, anon_rss);
+		file = get_mm_counter(mm, file_rss);
+		swap = get_mm_counter(mm, swap_ents);
+		hiwater_rss = max(mm->hiwater_rss, anon + file);
+		size = mm->total_vm;
+		locked = mm->locked_vm;
+		ptes = mm->nr_ptes;
+		mmput(mm);
+	}
+	seq_printf(m, "%lu %lu %lu %lu %lu %lu %lu %lu\n",
+		   size, anon + file, anon, file, swap, hiwater_rss,
+		   locked, ptes);
+
+	return 0;
+}
+
 static void pad_len_spaces(struct seq_file *m, int len)
 {
 	len = 25 + sizeof(void*) * 6 - len;
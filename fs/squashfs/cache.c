@@ -30,7 +30,10 @@
  * access the metadata and fragment caches.
  *
  * To avoid out of memory and fragmentation isssues with vmalloc the cache
- * uses sequences of kmalloced PAGE_CACHE_SIZE buffers.
+ * uses sequences of kmalloced PAGE_CACHE_SIZE buffers.  These are allocated
+ * when an entry is first filled, and the buffers of idle entries are given
+ * back under memory pressure by a shrinker, so the number of entries (set
+ * with mount options) only bounds the memory used.
  *
  * It should be noted that the cache is not used for file datablocks, these
  * are decompressed and cached in the page-cache in the normal way.  The
@@ -51,14 +54,64 @@
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/wait.h>
-#include <linux/zlib.h>
 #include <linux/pagemap.h>
+#include <linux/mm.h>
+#include <linux/init.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
 
+/* All caches of all mounted filesystems, for the shrinker */
+static LIST_HEAD(squashfs_caches);
+static DEFINE_SPINLOCK(squashfs_caches_lock);
+
+
+/*
+ * Allocate any buffers of the cache entry the shrinker has taken away (or
+ * which were never allocated).  The entry is pending, so the shrinker
+ * won't touch it meanwhile.
+ */
+static int squashfs_cache_entry_alloc(struct squashfs_cache *cache,
+	struct squashfs_cache_entry *entry)
+{
+	int i;
+
+	for (i = 0; i < cache->pages; i++) {
+		if (entry->data[i])
+			continue;
+		entry->data[i] = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
+		if (entry->data[i] == NULL) {
+			ERROR("Failed to allocate %s buffer\n", cache->name);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * Free the buffers of an entry, returning the number of pages freed.
+ */
+static int squashfs_cache_entry_free(struct squashfs_cache *cache,
+	struct squashfs_cache_entry *entry)
+{
+	int i, freed = 0;
+
+	for (i = 0; i < cache->pages; i++) {
+		if (entry->data[i] == NULL)
+			continue;
+		kfree(entry->data[i]);
+		entry->data[i] = NULL;
+		freed++;
+	}
+
+	return freed;
+}
+
+
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
  * and decompress it from disk.
@@ -66,7 +119,7 @@
 struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	struct squashfs_cache *cache, u64 block, int length)
 {
-	int i, n;
+	int i;
 	struct squashfs_cache_entry *entry;
 
 	spin_lock(&cache->lock);
@@ -91,25 +144,21 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  Unused entries
+			 * are kept in LRU order, with empty entries first, so
+			 * evict the least recently used.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
-			}
-
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
+			entry = list_first_entry(&cache->lru,
+					struct squashfs_cache_entry, lru);
+			list_del_init(&entry->lru);
+			i = entry - cache->entry;
 
 			/*
 			 * Initialise choosen cache entry, and fill it in from
 			 * disk.
 			 */
 			cache->unused--;
+			cache->misses++;
 			entry->block = block;
 			entry->refcount = 1;
 			entry->pending = 1;
@@ -117,9 +166,12 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			entry->error = 0;
 			spin_unlock(&cache->lock);
 
-			entry->length = squashfs_read_data(sb, entry->data,
-				block, length, &entry->next_index,
-				cache->block_size, cache->pages);
+			entry->length = squashfs_cache_entry_alloc(cache, entry);
+			if (entry->length == 0)
+				entry->length = squashfs_read_data(sb,
+					entry->data, block, length,
+					&entry->next_index, cache->block_size,
+					cache->pages);
 
 			spin_lock(&cache->lock);
 
@@ -149,9 +201,12 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * for reuse.
 		 */
 		entry = &cache->entry[i];
-		if (entry->refcount == 0)
+		if (entry->refcount == 0) {
 			cache->unused--;
+			list_del_init(&entry->lru);
+		}
 		entry->refcount++;
+		cache->hits++;
 
 		/*
 		 * If the entry is currently being filled in by another process
@@ -179,7 +234,8 @@ out:
 
 
 /*
- * Release cache entry, once usage count is zero it can be reused.
+ * Release cache entry, once usage count is zero it can be reused.  Entries
+ * which failed to read are forgotten, so that the next look-up retries.
  */
 void squashfs_cache_put(struct squashfs_cache_entry *entry)
 {
@@ -189,6 +245,11 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	entry->refcount--;
 	if (entry->refcount == 0) {
 		cache->unused++;
+		if (entry->error) {
+			entry->block = SQUASHFS_INVALID_BLK;
+			list_add(&entry->lru, &cache->lru);
+		} else
+			list_add_tail(&entry->lru, &cache->lru);
 		/*
 		 * If there's any processes waiting for a block to become
 		 * available, wake one up.
@@ -207,15 +268,18 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
  */
 void squashfs_cache_delete(struct squashfs_cache *cache)
 {
-	int i, j;
+	int i;
 
 	if (cache == NULL)
 		return;
 
-	for (i = 0; i < cache->entries; i++) {
+	spin_lock(&squashfs_caches_lock);
+	list_del(&cache->list);
+	spin_unlock(&squashfs_caches_lock);
+
+	for (i = 0; cache->entry && i < cache->entries; i++) {
 		if (cache->entry[i].data) {
-			for (j = 0; j < cache->pages; j++)
-				kfree(cache->entry[i].data[j]);
+			squashfs_cache_entry_free(cache, &cache->entry[i]);
 			kfree(cache->entry[i].data);
 		}
 	}
@@ -226,14 +290,15 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 
 
 /*
- * Initialise cache allocating the specified number of entries, each of
- * size block_size.  To avoid vmalloc fragmentation issues each entry
- * is allocated as a sequence of kmalloced PAGE_CACHE_SIZE buffers.
+ * Initialise cache with the specified number of entries, each of size
+ * block_size.  To avoid vmalloc fragmentation issues each entry is a
+ * sequence of kmalloced PAGE_CACHE_SIZE buffers, allocated when the
+ * entry is first used.
  */
 struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	int block_size)
 {
-	int i, j;
+	int i;
 	struct squashfs_cache *cache = kzalloc(sizeof(*cache), GFP_KERNEL);
 
 	if (cache == NULL) {
@@ -241,13 +306,15 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		return NULL;
 	}
 
+	INIT_LIST_HEAD(&cache->lru);
+	INIT_LIST_HEAD(&cache->list);
+
 	cache->entry = kcalloc(entries, sizeof(*(cache->entry)), GFP_KERNEL);
 	if (cache->entry == NULL) {
 		ERROR("Failed to allocate %s cache\n", name);
 		goto cleanup;
 	}
 
-	cache->next_blk = 0;
 	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
@@ -269,16 +336,14 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 			ERROR("Failed to allocate %s cache entry\n", name);
 			goto cleanup;
 		}
-
-		for (j = 0; j < cache->pages; j++) {
-			entry->data[j] = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
-			if (entry->data[j] == NULL) {
-				ERROR("Failed to allocate %s buffer\n", name);
-				goto cleanup;
-			}
-		}
+		list_add_tail(&entry->lru, &cache->lru);
 	}
 
+	/* Only now may the shrinker see the cache */
+	spin_lock(&squashfs_caches_lock);
+	list_add_tail(&cache->list, &squashfs_caches);
+	spin_unlock(&squashfs_caches_lock);
+
 	return cache;
 
 cleanup:
@@ -287,6 +352,58 @@ cleanup:
 }
 
 
+/*
+ * Free the buffers of idle entries, least recently used first, in all
+ * caches until nr_to_scan pages have been freed.  Emptied entries move
+ * to the front of their LRU, to be reused before any still holding data.
+ * Returns the number of pages still held by idle entries.
+ */
+static int squashfs_cache_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct squashfs_cache *cache;
+	struct squashfs_cache_entry *entry, *next;
+	int count = 0;
+
+	spin_lock(&squashfs_caches_lock);
+	list_for_each_entry(cache, &squashfs_caches, list) {
+		spin_lock(&cache->lock);
+		list_for_each_entry_safe(entry, next, &cache->lru, lru) {
+			if (entry->data[0] == NULL)
+				continue;
+			if (nr_to_scan > 0) {
+				entry->block = SQUASHFS_INVALID_BLK;
+				nr_to_scan -= squashfs_cache_entry_free(cache,
+								entry);
+				list_move(&entry->lru, &cache->lru);
+			} else
+				count += cache->pages;
+		}
+		spin_unlock(&cache->lock);
+	}
+	spin_unlock(&squashfs_caches_lock);
+
+	return count;
+}
+
+
+static struct shrinker squashfs_cache_shrinker = {
+	.shrink = squashfs_cache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+
+void __init squashfs_cache_register_shrinker(void)
+{
+	register_shrinker(&squashfs_cache_shrinker);
+}
+
+
+void squashfs_cache_unregister_shrinker(void)
+{
+	unregister_shrinker(&squashfs_cache_shrinker);
+}
+
+
 /*
  * Copy upto length bytes from cache entry to buffer starting at offset bytes
  * into the cache entry.  If there's not length bytes then copy the number of
@@ -47,7 +47,7 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
-#include <linux/zlib.h>
+#include <linux/zcache.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -372,6 +372,94 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress a datablock straight into the page cache pages it covers,
+ * avoiding the single read_page cache entry and the copy out of it.
+ * All of the pages must be grabbed up front; if one of them is busy or
+ * already uptodate -EAGAIN is returned and nothing has been read, and
+ * the caller falls back to reading the block through the cache.
+ * On success every page, including target_page, has been unlocked.
+ */
+static int squashfs_readpage_direct(struct page *target_page, u64 block,
+	int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int i, pages, bytes, res = -EAGAIN;
+	struct page **page;
+	void **pageaddr;
+
+	if (end_index > file_end)
+		end_index = file_end;
+	pages = end_index - start_index + 1;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	pageaddr = kcalloc(pages, sizeof(*pageaddr), GFP_KERNEL);
+	if (page == NULL || pageaddr == NULL)
+		goto out;
+
+	for (i = 0; i < pages; i++) {
+		if (start_index + i == target_page->index) {
+			page[i] = target_page;
+			continue;
+		}
+		page[i] = grab_cache_page_nowait(target_page->mapping,
+							start_index + i);
+		if (page[i] == NULL)
+			goto release_pages;
+		if (PageUptodate(page[i])) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+			page[i] = NULL;
+			goto release_pages;
+		}
+	}
+
+	for (i = 0; i < pages; i++)
+		pageaddr[i] = kmap(page[i]);
+
+	res = squashfs_read_data(inode->i_sb, pageaddr, block, bsize, NULL,
+				pages << PAGE_CACHE_SHIFT, pages);
+
+	for (i = 0, bytes = res; i < pages; i++, bytes -= PAGE_CACHE_SIZE) {
+		int avail = clamp_t(int, bytes, 0, PAGE_CACHE_SIZE);
+
+		if (res >= 0 && avail < PAGE_CACHE_SIZE)
+			memset(pageaddr[i] + avail, 0, PAGE_CACHE_SIZE - avail);
+		kunmap(page[i]);
+		if (res < 0)
+			continue;
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+		page[i] = NULL;
+	}
+
+	if (res >= 0)
+		res = 0;
+
+release_pages:
+	/* Anything still held here was not read, leave it to readpage */
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL || page[i] == target_page)
+			continue;
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+
+out:
+	kfree(pageaddr);
+	kfree(page);
+	return res;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -393,6 +481,12 @@ static int squashfs_readpage(struct file *file, struct page *page)
 					PAGE_CACHE_SHIFT))
 		goto out;
 
+	if (zcache_get_page(page) == 0) {
+		SetPageUptodate(page);
+		unlock_page(page);
+		return 0;
+	}
+
 	if (index < file_end || squashfs_i(inode)->fragment_block ==
 					SQUASHFS_INVALID_BLK) {
 		/*
@@ -411,8 +505,18 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Read and decompress datablock, directly into the
+			 * page cache if all of its pages can be had.
 			 */
+			int res = squashfs_readpage_direct(page, block, bsize);
+			if (res == 0)
+				return 0;
+			if (res != -EAGAIN) {
+				ERROR("Unable to read page, block %llx, size %x"
+					"\n", block, bsize);
+				goto error_out;
+			}
+
 			buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
 			if (buffer->error) {
@@ -177,6 +177,8 @@
 
 /* cached data constants for filesystem */
 #define SQUASHFS_CACHED_BLKS		8
+#define SQUASHFS_CACHED_DATA		1
+#define SQUASHFS_CACHE_MAX_ENTRIES	64
 
 #define SQUASHFS_MAX_FILE_SIZE_LOG	64
 
@@ -212,6 +214,9 @@ struct meta_index {
  * definitions for structures on disk
  */
 #define ZLIB_COMPRESSION	 1
+#define LZMA_COMPRESSION	 2
+#define LZO_COMPRESSION		 3
+#define XZ_COMPRESSION		 4
 
 struct squashfs_super_block {
 	__le32			s_magic;
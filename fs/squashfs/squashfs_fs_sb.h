@@ -28,7 +28,6 @@
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			next_blk;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
@@ -36,6 +35,10 @@ struct squashfs_cache {
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache_entry *entry;
+	struct list_head	lru;
+	struct list_head	list;
+	unsigned long		hits;
+	unsigned long		misses;
 };
 
 struct squashfs_cache_entry {
@@ -48,6 +51,7 @@ struct squashfs_cache_entry {
 	int			num_waiters;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache	*cache;
+	struct list_head	lru;
 	void			**data;
 };
 
@@ -64,7 +68,8 @@ struct squashfs_sb_info {
 	struct mutex		read_data_mutex;
 	struct mutex		meta_index_mutex;
 	struct meta_index	*meta_index;
-	z_stream		stream;
+	const struct squashfs_decompressor	*decompressor;
+	void			*stream;
 	__le64			*inode_lookup_table;
 	u64			inode_table;
 	u64			directory_table;
@@ -72,5 +77,7 @@ struct squashfs_sb_info {
 	unsigned short		block_log;
 	long long		bytes_used;
 	unsigned int		inodes;
+	struct kobject		kobj;
+	struct completion	kobj_unregister;
 };
 #endif
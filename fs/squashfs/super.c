@@ -35,34 +35,120 @@
 #include <linux/pagemap.h>
 #include <linux/init.h>
 #include <linux/module.h>
-#include <linux/zlib.h>
 #include <linux/magic.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/mount.h>
+#include <linux/kobject.h>
+#include <linux/completion.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "decompressor.h"
 
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
+static struct kset *squashfs_kset;
+static struct kobj_type squashfs_ktype;
 
-static int supported_squashfs_filesystem(short major, short minor, short comp)
+struct squashfs_mount_opts {
+	int	metadata_cache;
+	int	fragment_cache;
+	int	data_cache;
+};
+
+enum {
+	Opt_metadata_cache, Opt_fragment_cache, Opt_data_cache, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_metadata_cache, "metadata_cache=%u"},
+	{Opt_fragment_cache, "fragment_cache=%u"},
+	{Opt_data_cache, "data_cache=%u"},
+	{Opt_err, NULL}
+};
+
+static int squashfs_parse_options(char *options,
+	struct squashfs_mount_opts *opts)
 {
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int option, *entries;
+
+	opts->metadata_cache = SQUASHFS_CACHED_BLKS;
+	opts->fragment_cache = SQUASHFS_CACHED_FRAGMENTS;
+	opts->data_cache = SQUASHFS_CACHED_DATA;
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		switch (match_token(p, tokens, args)) {
+		case Opt_metadata_cache:
+			entries = &opts->metadata_cache;
+			break;
+		case Opt_fragment_cache:
+			entries = &opts->fragment_cache;
+			break;
+		case Opt_data_cache:
+			entries = &opts->data_cache;
+			break;
+		default:
+			ERROR("Unrecognized mount option \"%s\"\n", p);
+			return -EINVAL;
+		}
+
+		if (match_int(&args[0], &option) || option < 1 ||
+				option > SQUASHFS_CACHE_MAX_ENTRIES) {
+			ERROR("Invalid cache size \"%s\", must be 1 to %d\n",
+				p, SQUASHFS_CACHE_MAX_ENTRIES);
+			return -EINVAL;
+		}
+		*entries = option;
+	}
+
+	return 0;
+}
+
+
+static void squashfs_sysfs_del(struct squashfs_sb_info *msblk)
+{
+	if (!msblk->kobj.state_initialized)
+		return;
+	kobject_put(&msblk->kobj);
+	wait_for_completion(&msblk->kobj_unregister);
+}
+
+
+static const struct squashfs_decompressor *supported_squashfs_filesystem(short
+	major, short minor, short id)
+{
+	const struct squashfs_decompressor *decompressor;
+
 	if (major < SQUASHFS_MAJOR) {
 		ERROR("Major/Minor mismatch, older Squashfs %d.%d "
 			"filesystems are unsupported\n", major, minor);
-		return -EINVAL;
+		return NULL;
 	} else if (major > SQUASHFS_MAJOR || minor > SQUASHFS_MINOR) {
 		ERROR("Major/Minor mismatch, trying to mount newer "
 			"%d.%d filesystem\n", major, minor);
 		ERROR("Please update your kernel\n");
-		return -EINVAL;
+		return NULL;
 	}
 
-	if (comp != ZLIB_COMPRESSION)
-		return -EINVAL;
+	decompressor = squashfs_lookup_decompressor(id);
+	if (!decompressor->supported) {
+		ERROR("Filesystem uses \"%s\" compression. This is not "
+			"supported\n", decompressor->name);
+		return NULL;
+	}
 
-	return 0;
+	return decompressor;
 }
 
 
@@ -70,6 +156,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
 	struct squashfs_super_block *sblk = NULL;
+	struct squashfs_mount_opts opts;
 	char b[BDEVNAME_SIZE];
 	struct inode *root;
 	long long root_inode;
@@ -80,6 +167,10 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 
 	TRACE("Entered squashfs_fill_superblock\n");
 
+	err = squashfs_parse_options(data, &opts);
+	if (err)
+		return err;
+
 	sb->s_fs_info = kzalloc(sizeof(*msblk), GFP_KERNEL);
 	if (sb->s_fs_info == NULL) {
 		ERROR("Failed to allocate squashfs_sb_info\n");
@@ -87,13 +178,6 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	msblk = sb->s_fs_info;
 
-	msblk->stream.workspace = kmalloc(zlib_inflate_workspacesize(),
-		GFP_KERNEL);
-	if (msblk->stream.workspace == NULL) {
-		ERROR("Failed to allocate zlib workspace\n");
-		goto failure;
-	}
-
 	sblk = kzalloc(sizeof(*sblk), GFP_KERNEL);
 	if (sblk == NULL) {
 		ERROR("Failed to allocate squashfs_super_block\n");
@@ -130,15 +214,16 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount;
 	}
 
-	/* Check the MAJOR & MINOR versions and compression type */
-	err = supported_squashfs_filesystem(le16_to_cpu(sblk->s_major),
+	err = -EINVAL;
+
+	/* Check the MAJOR & MINOR versions and lookup compression type */
+	msblk->decompressor = supported_squashfs_filesystem(
+			le16_to_cpu(sblk->s_major),
 			le16_to_cpu(sblk->s_minor),
 			le16_to_cpu(sblk->compression));
-	if (err < 0)
+	if (msblk->decompressor == NULL)
 		goto failed_mount;
 
-	err = -EINVAL;
-
 	/*
 	 * Check if there's xattrs in the filesystem.  These are not
 	 * supported in this version, so warn that they will be ignored.
@@ -172,6 +257,13 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_log > SQUASHFS_FILE_MAX_LOG)
 		goto failed_mount;
 
+	/* Allocate the decompressor state, sized for the block size */
+	msblk->stream = squashfs_decompressor_init(msblk);
+	if (msblk->stream == NULL) {
+		err = -ENOMEM;
+		goto failed_mount;
+	}
+
 	/* Check the root inode for sanity */
 	root_inode = le64_to_cpu(sblk->root_inode);
 	if (SQUASHFS_INODE_OFFSET(root_inode) > SQUASHFS_METADATA_SIZE)
@@ -206,17 +298,26 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			opts.metadata_cache, SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
 	/* Allocate read_page block */
-	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
+	msblk->read_page = squashfs_cache_init("data", opts.data_cache,
+			msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
 	}
 
+	/* Cache statistics in /sys/fs/squashfs/<dev> */
+	msblk->kobj.kset = squashfs_kset;
+	init_completion(&msblk->kobj_unregister);
+	err = kobject_init_and_add(&msblk->kobj, &squashfs_ktype, NULL,
+			"%s", sb->s_id);
+	if (err)
+		goto failed_mount;
+
 	/* Allocate and read id index table */
 	msblk->id_table = squashfs_read_id_index_table(sb,
 		le64_to_cpu(sblk->id_table_start), le16_to_cpu(sblk->no_ids));
@@ -231,7 +332,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto allocate_lookup_table;
 
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		opts.fragment_cache, msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -289,20 +390,20 @@ allocate_root:
 	return 0;
 
 failed_mount:
+	squashfs_sysfs_del(msblk);
 	squashfs_cache_delete(msblk->block_cache);
 	squashfs_cache_delete(msblk->fragment_cache);
 	squashfs_cache_delete(msblk->read_page);
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
-	kfree(msblk->stream.workspace);
+	squashfs_decompressor_free(msblk, msblk->stream);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	kfree(sblk);
 	return err;
 
 failure:
-	kfree(msblk->stream.workspace);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	return -ENOMEM;
@@ -343,13 +444,14 @@ static void squashfs_put_super(struct super_block *sb)
 
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		squashfs_sysfs_del(sbi);
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
-		kfree(sbi->stream.workspace);
+		squashfs_decompressor_free(sbi, sbi->stream);
 		kfree(sb->s_fs_info);
 		sb->s_fs_info = NULL;
 	}
@@ -358,6 +460,106 @@ static void squashfs_put_super(struct super_block *sb)
 }
 
 
+static int squashfs_show_options(struct seq_file *seq, struct vfsmount *vfs)
+{
+	struct squashfs_sb_info *msblk = vfs->mnt_sb->s_fs_info;
+
+	if (msblk->block_cache->entries != SQUASHFS_CACHED_BLKS)
+		seq_printf(seq, ",metadata_cache=%d",
+			msblk->block_cache->entries);
+	if (msblk->fragment_cache &&
+		msblk->fragment_cache->entries != SQUASHFS_CACHED_FRAGMENTS)
+		seq_printf(seq, ",fragment_cache=%d",
+			msblk->fragment_cache->entries);
+	if (msblk->read_page->entries != SQUASHFS_CACHED_DATA)
+		seq_printf(seq, ",data_cache=%d", msblk->read_page->entries);
+
+	return 0;
+}
+
+
+/*
+ * Per filesystem cache statistics.  Each attribute shows one field of
+ * one of the three caches, found by its offset in squashfs_sb_info.
+ */
+struct squashfs_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct squashfs_cache *, char *);
+	size_t cache;
+};
+
+static ssize_t cache_entries_show(struct squashfs_cache *cache, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n", cache ? cache->entries : 0);
+}
+
+static ssize_t cache_hits_show(struct squashfs_cache *cache, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lu\n", cache ? cache->hits : 0);
+}
+
+static ssize_t cache_misses_show(struct squashfs_cache *cache, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lu\n", cache ? cache->misses : 0);
+}
+
+#define SQUASHFS_CACHE_ATTR(_cache, _field, _name)			\
+static struct squashfs_attr squashfs_attr_##_name##_cache_##_field = {	\
+	.attr = {.name = __stringify(_name) "_cache_" #_field,		\
+		 .mode = 0444 },					\
+	.show	= cache_##_field##_show,				\
+	.cache	= offsetof(struct squashfs_sb_info, _cache),		\
+}
+#define SQUASHFS_CACHE_ATTRS(_cache, _name)				\
+	SQUASHFS_CACHE_ATTR(_cache, entries, _name);			\
+	SQUASHFS_CACHE_ATTR(_cache, hits, _name);			\
+	SQUASHFS_CACHE_ATTR(_cache, misses, _name)
+#define ATTR_LIST(_name)						\
+	&squashfs_attr_##_name##_cache_entries.attr,			\
+	&squashfs_attr_##_name##_cache_hits.attr,			\
+	&squashfs_attr_##_name##_cache_misses.attr
+
+SQUASHFS_CACHE_ATTRS(block_cache, metadata);
+SQUASHFS_CACHE_ATTRS(fragment_cache, fragment);
+SQUASHFS_CACHE_ATTRS(read_page, data);
+
+static struct attribute *squashfs_attrs[] = {
+	ATTR_LIST(metadata),
+	ATTR_LIST(fragment),
+	ATTR_LIST(data),
+	NULL,
+};
+
+static ssize_t squashfs_attr_show(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+					struct squashfs_sb_info, kobj);
+	struct squashfs_attr *a = container_of(attr, struct squashfs_attr,
+					attr);
+
+	return a->show(*(struct squashfs_cache **)((char *)msblk + a->cache),
+			buf);
+}
+
+static void squashfs_sb_release(struct kobject *kobj)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+					struct squashfs_sb_info, kobj);
+	complete(&msblk->kobj_unregister);
+}
+
+static struct sysfs_ops squashfs_attr_ops = {
+	.show	= squashfs_attr_show,
+};
+
+static struct kobj_type squashfs_ktype = {
+	.default_attrs	= squashfs_attrs,
+	.sysfs_ops	= &squashfs_attr_ops,
+	.release	= squashfs_sb_release,
+};
+
+
 static int squashfs_get_sb(struct file_system_type *fs_type, int flags,
 				const char *dev_name, void *data,
 				struct vfsmount *mnt)
@@ -401,8 +603,18 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	squashfs_kset = kset_create_and_add("squashfs", NULL, fs_kobj);
+	if (!squashfs_kset) {
+		destroy_inodecache();
+		return -ENOMEM;
+	}
+
+	squashfs_cache_register_shrinker();
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		squashfs_cache_unregister_shrinker();
+		kset_unregister(squashfs_kset);
 		destroy_inodecache();
 		return err;
 	}
@@ -417,6 +629,8 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	squashfs_cache_unregister_shrinker();
+	kset_unregister(squashfs_kset);
 	destroy_inodecache();
 }
 
@@ -441,7 +655,7 @@ static struct file_system_type squashfs_fs_type = {
 	.name = "squashfs",
 	.get_sb = squashfs_get_sb,
 	.kill_sb = kill_block_super,
-	.fs_flags = FS_REQUIRES_DEV
+	.fs_flags = FS_REQUIRES_DEV | FS_ZCACHE
 };
 
 static const struct super_operations squashfs_super_ops = {
@@ -449,7 +663,8 @@ static const struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
-	.remount_fs = squashfs_remount
+	.remount_fs = squashfs_remount,
+	.show_options = squashfs_show_options
 };
 
 module_init(init_squashfs_fs);
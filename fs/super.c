@@ -37,6 +37,7 @@
 #include <linux/kobject.h>
 #include <linux/mutex.h>
 #include <linux/file.h>
+#include <linux/zcache.h>
 #include <asm/uaccess.h>
 #include "internal.h"
 
@@ -316,6 +317,7 @@ void generic_shutdown_super(struct super_block *sb)
 			   "Self-destruct in 5 seconds.  Have a nice day...\n",
 			   sb->s_id);
 		}
+		zcache_flush_fs(sb);
 		put_fs_excl();
 	}
 	spin_lock(&sb_lock);
@@ -52,6 +52,7 @@
 #include "ubifs.h"
 #include <linux/mount.h>
 #include <linux/namei.h>
+#include <linux/zcache.h>
 
 static int read_block(struct inode *inode, void *addr, unsigned int block,
 		      struct ubifs_data_node *dn)
@@ -880,9 +881,21 @@ out_unlock:
 
 static int ubifs_readpage(struct file *file, struct page *page)
 {
+	ktime_t start;
+
+	if (zcache_get_page(page) == 0) {
+		SetPageUptodate(page);
+		unlock_page(page);
+		return 0;
+	}
 	if (ubifs_bulk_read(page))
 		return 0;
+
+	/* reads are synchronous, feed the readahead statistics here */
+	start = ktime_get();
 	do_readpage(page);
+	bdi_account_read(page->mapping->backing_dev_info, PAGE_CACHE_SIZE,
+			 ktime_us_delta(ktime_get(), start));
 	unlock_page(page);
 	return 0;
 }
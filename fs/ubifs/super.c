@@ -2092,6 +2092,7 @@ static struct file_system_type ubifs_fs_type = {
 	.owner   = THIS_MODULE,
 	.get_sb  = ubifs_get_sb,
 	.kill_sb = kill_anon_super,
+	.fs_flags = FS_ZCACHE,
 };
 
 /*
@@ -78,6 +78,20 @@ struct backing_dev_info {
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
+	/*
+	 * Read completion statistics, and the history of readahead windows
+	 * opened without knowing the access pattern, used to size
+	 * readahead when ra_adaptive is set.  The averages are kept scaled
+	 * by 2^BDI_READ_AVG_SHIFT so that samples smaller than that still
+	 * move them.  Updated without locking: a racing update only loses a
+	 * sample.
+	 */
+	unsigned int ra_adaptive;
+	unsigned long read_bytes_avg;	/* moving average of read size */
+	unsigned long read_usecs_avg;	/* ... and of its completion time */
+	unsigned int ra_initial;	/* initial windows opened */
+	unsigned int ra_initial_hits;	/* ... and then read sequentially */
+
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
 	spinlock_t wb_lock;	  /* protects update side of wb_list */
 	struct list_head wb_list; /* the flusher threads hanging off this bdi */
@@ -197,6 +211,11 @@ static inline unsigned long bdi_stat_error(struct backing_dev_info *bdi)
 int bdi_set_min_ratio(struct backing_dev_info *bdi, unsigned int min_ratio);
 int bdi_set_max_ratio(struct backing_dev_info *bdi, unsigned int max_ratio);
 
+void bdi_account_read(struct backing_dev_info *bdi, unsigned long bytes,
+		      unsigned long usecs);
+unsigned long bdi_read_throughput(struct backing_dev_info *bdi);
+unsigned long bdi_read_latency(struct backing_dev_info *bdi);
+
 /*
  * Flags in backing_dev_info::capability
  *
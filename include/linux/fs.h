@@ -175,6 +175,10 @@ struct inodes_stat_t {
 #define FS_REQUIRES_DEV 1 
 #define FS_BINARY_MOUNTDATA 2
 #define FS_HAS_SUBTYPE 4
+#define FS_ZCACHE	8	/* Clean pages may be kept compressed */
+#define FS_RCU_INODES	16	/* ->destroy_inode frees after an RCU grace
+				 * period, so lockless path walk may look at
+				 * the inodes. */
 #define FS_REVAL_DOT	16384	/* Check the paths ".", ".." for staleness */
 #define FS_RENAME_DOES_D_MOVE	32768	/* FS will handle d_move()
 					 * during rename() internally.
@@ -725,6 +729,7 @@ struct inode {
 	struct list_head	i_list;		/* backing dev IO list */
 	struct list_head	i_sb_list;
 	struct list_head	i_dentry;
+	struct rcu_head		i_rcu;
 	unsigned long		i_ino;
 	atomic_t		i_count;
 	unsigned int		i_nlink;
@@ -894,6 +899,8 @@ struct file_ra_state {
 
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
+	unsigned int initial;		/* Initial window not yet read past
+					   its readahead marker */
 	loff_t prev_pos;		/* Cache last read() position */
 };
 
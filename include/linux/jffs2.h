@@ -67,6 +67,10 @@
 #define JFFS2_NODETYPE_XATTR (JFFS2_FEATURE_INCOMPAT | JFFS2_NODE_ACCURATE | 8)
 #define JFFS2_NODETYPE_XREF (JFFS2_FEATURE_INCOMPAT | JFFS2_NODE_ACCURATE | 9)
 
+/* ROCOMPAT: a kernel which cannot invalidate a checkpoint must not write */
+#define JFFS2_NODETYPE_CHECKPOINT (JFFS2_FEATURE_ROCOMPAT | JFFS2_NODE_ACCURATE | 10)
+#define JFFS2_NODETYPE_CHECKPOINT_DATA (JFFS2_FEATURE_RWCOMPAT_DELETE | JFFS2_NODE_ACCURATE | 11)
+
 /* XATTR Related */
 #define JFFS2_XPREFIX_USER		1	/* for "user." */
 #define JFFS2_XPREFIX_SECURITY		2	/* for "security." */
@@ -77,7 +81,6 @@
 #define JFFS2_ACL_VERSION		0x0001
 
 // Maybe later...
-//#define JFFS2_NODETYPE_CHECKPOINT (JFFS2_FEATURE_RWCOMPAT_DELETE | JFFS2_NODE_ACCURATE | 3)
 //#define JFFS2_NODETYPE_OPTIONS (JFFS2_FEATURE_RWCOMPAT_COPY | JFFS2_NODE_ACCURATE | 4)
 
 
@@ -203,6 +206,28 @@ struct jffs2_raw_summary
 	jint32_t sum[0]; 	/* inode summary info */
 };
 
+struct jffs2_raw_checkpoint
+{
+	jint16_t magic;
+	jint16_t nodetype;	/* = JFFS2_NODETYPE_CHECKPOINT */
+	jint32_t totlen;
+	jint32_t hdr_crc;
+	jint32_t seqno;		/* the highest valid one is used */
+	jint32_t flash_size;	/* geometry the checkpoint describes */
+	jint32_t sector_size;
+	jint32_t cln_mkr;	/* clean marker size */
+	jint32_t highest_ino;
+	jint32_t nr_inodes;	/* number of inode records */
+	jint32_t nr_blocks;	/* number of eraseblock records */
+	jint32_t nr_refs;	/* number of node records */
+	jint32_t data_len;	/* length of all records */
+	jint32_t data_crc;	/* crc of all records */
+	jint32_t slot;		/* invalidation slot, erased while valid */
+	jint32_t nr_chain;	/* number of data nodes */
+	jint32_t node_crc;	/* crc of the node and the chain */
+	jint32_t chain[0];	/* eraseblocks holding the data nodes */
+};
+
 union jffs2_node_union
 {
 	struct jffs2_raw_inode i;
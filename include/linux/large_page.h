@@ -0,0 +1,53 @@
+#ifndef __LINUX_LARGE_PAGE_H
+#define __LINUX_LARGE_PAGE_H
+/*
+ * Transparent large pages.
+ *
+ * Anonymous memory is backed by naturally aligned, physically contiguous
+ * groups of ordinary pages, which the architecture maps with a single
+ * large TLB entry whenever it finds such a group in the page tables.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+
+#ifdef CONFIG_TRANSPARENT_LARGE_PAGE
+int large_page_fault(struct mm_struct *mm, struct vm_area_struct *vma,
+		     unsigned long address, pmd_t *pmd);
+int __large_page_enter(struct mm_struct *mm);
+void __large_page_exit(struct mm_struct *mm);
+
+static inline int large_page_fork(struct mm_struct *mm,
+				  struct mm_struct *oldmm)
+{
+	if (test_bit(MMF_VM_LARGE_PAGE, &oldmm->flags))
+		return __large_page_enter(mm);
+	return 0;
+}
+
+static inline void large_page_exit(struct mm_struct *mm)
+{
+	if (test_bit(MMF_VM_LARGE_PAGE, &mm->flags))
+		__large_page_exit(mm);
+}
+#else  /* !CONFIG_TRANSPARENT_LARGE_PAGE */
+
+static inline int large_page_fault(struct mm_struct *mm,
+				   struct vm_area_struct *vma,
+				   unsigned long address, pmd_t *pmd)
+{
+	return 0;
+}
+
+static inline int large_page_fork(struct mm_struct *mm,
+				  struct mm_struct *oldmm)
+{
+	return 0;
+}
+
+static inline void large_page_exit(struct mm_struct *mm)
+{
+}
+#endif /* !CONFIG_TRANSPARENT_LARGE_PAGE */
+
+#endif /* __LINUX_LARGE_PAGE_H */
@@ -336,6 +336,7 @@ void put_page(struct page *page);
 void put_pages_list(struct list_head *pages);
 
 void split_page(struct page *page, unsigned int order);
+int split_free_page(struct page *page);
 
 /*
  * Compound pages have a destructor function.  Provide a
@@ -512,6 +513,25 @@ static inline void set_compound_order(struct page *page, unsigned long order)
 #define SECTIONS_MASK		((1UL << SECTIONS_WIDTH) - 1)
 #define ZONEID_MASK		((1UL << ZONEID_SHIFT) - 1)
 
+/*
+ * On SMP the processor that allocated an order-0 page is kept below the
+ * zone, if the flags have room for it, so that a free on another processor
+ * can hand the page back to the allocating one:
+ *
+ *	| [SECTION] | [NODE] | ZONE | [ALLOC_CPU] | ... | FLAGS |
+ */
+#if defined(CONFIG_SMP) && NR_CPUS_BITS > 0 && \
+	SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+NR_CPUS_BITS <= \
+		BITS_PER_LONG - NR_PAGEFLAGS
+#define ALLOC_CPU_WIDTH		NR_CPUS_BITS
+#else
+#define ALLOC_CPU_WIDTH		0
+#endif
+
+#define ALLOC_CPU_PGOFF		(ZONES_PGOFF - ALLOC_CPU_WIDTH)
+#define ALLOC_CPU_PGSHIFT	(ALLOC_CPU_PGOFF * (ALLOC_CPU_WIDTH != 0))
+#define ALLOC_CPU_MASK		((1UL << ALLOC_CPU_WIDTH) - 1)
+
 static inline enum zone_type page_zonenum(struct page *page)
 {
 	return (page->flags >> ZONES_PGSHIFT) & ZONES_MASK;
@@ -578,6 +598,29 @@ static inline void set_page_section(struct page *page, unsigned long section)
 	page->flags |= (section & SECTIONS_MASK) << SECTIONS_PGSHIFT;
 }
 
+#if ALLOC_CPU_WIDTH
+static inline int page_alloc_cpu(struct page *page)
+{
+	return (page->flags >> ALLOC_CPU_PGSHIFT) & ALLOC_CPU_MASK;
+}
+
+/* Only for pages the caller owns exclusively, the update is not atomic */
+static inline void set_page_alloc_cpu(struct page *page, int cpu)
+{
+	page->flags &= ~(ALLOC_CPU_MASK << ALLOC_CPU_PGSHIFT);
+	page->flags |= (cpu & ALLOC_CPU_MASK) << ALLOC_CPU_PGSHIFT;
+}
+#else
+static inline int page_alloc_cpu(struct page *page)
+{
+	return -1;
+}
+
+static inline void set_page_alloc_cpu(struct page *page, int cpu)
+{
+}
+#endif
+
 static inline void set_page_links(struct page *page, enum zone_type zone,
 	unsigned long node, unsigned long pfn)
 {
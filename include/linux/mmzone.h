@@ -40,8 +40,26 @@
 #define MIGRATE_MOVABLE       2
 #define MIGRATE_PCPTYPES      3 /* the number of types on the pcp lists */
 #define MIGRATE_RESERVE       3
+#ifdef CONFIG_CMA
+/*
+ * MIGRATE_CMA pageblocks belong to a contiguous memory area (see
+ * mm/bpa2.c) which is lent to the page allocator. Only movable
+ * allocations may use them and their type is never stolen, so the
+ * pages can always be migrated away when the area is claimed back.
+ */
+#define MIGRATE_CMA           4
+#define MIGRATE_ISOLATE       5 /* can't allocate from here */
+#define MIGRATE_TYPES         6
+#else
 #define MIGRATE_ISOLATE       4 /* can't allocate from here */
 #define MIGRATE_TYPES         5
+#endif
+
+#ifdef CONFIG_CMA
+#  define is_migrate_cma(migratetype) unlikely((migratetype) == MIGRATE_CMA)
+#else
+#  define is_migrate_cma(migratetype) false
+#endif
 
 #define for_each_migratetype_order(order, type) \
 	for (order = 0; order < MAX_ORDER; order++) \
@@ -104,6 +122,8 @@ enum zone_stat_item {
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
+	PCP_REMOTE_FREE,	/* freed to the allocating cpu's pcp-lists */
+	PCP_REMOTE_REFILL,	/* pcp-lists refilled from remote frees */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -173,6 +193,21 @@ struct per_cpu_pages {
 
 	/* Lists of pages, one per migrate type stored on the pcp-lists */
 	struct list_head lists[MIGRATE_PCPTYPES];
+
+#ifdef CONFIG_SMP
+	/*
+	 * Pages allocated by this processor and freed by others, handed
+	 * over in batches. Protected by remote_lock.
+	 */
+	spinlock_t remote_lock;
+	int remote_count;
+	struct list_head remote;
+
+	/* Pages freed here that are being batched for staged_cpu */
+	int staged_cpu;
+	int staged_count;
+	struct list_head staged;
+#endif
 };
 
 struct per_cpu_pageset {
@@ -335,6 +370,15 @@ struct zone {
 	unsigned long		*pageblock_flags;
 #endif /* CONFIG_SPARSEMEM */
 
+#ifdef CONFIG_COMPACTION
+	/*
+	 * On compaction failure, 1<<compact_defer_shift compactions
+	 * are skipped before trying again. The number attempted since
+	 * last failure is tracked with compact_considered.
+	 */
+	unsigned int		compact_considered;
+	unsigned int		compact_defer_shift;
+#endif
 
 	ZONE_PADDING(_pad1_)
 
@@ -309,6 +309,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@tc_index: Traffic control index
  *	@tc_verd: traffic control verdict
  *	@ndisc_nodetype: router type (from link layer)
+ *	@head_frag: skb head is a page fragment, not a kmalloc() buffer
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
  *	@secmark: security marking
@@ -384,9 +385,10 @@ struct sk_buff {
 #ifdef CONFIG_IPV6_NDISC_NODETYPE
 	__u8			ndisc_nodetype:2;
 #endif
+	__u8			head_frag:1;
 	kmemcheck_bitfield_end(flags2);
 
-	/* 0/14 bit hole */
+	/* 0/13 bit hole */
 
 #ifdef CONFIG_NET_DMA
 	dma_cookie_t		dma_cookie;
@@ -447,6 +449,7 @@ extern void consume_skb(struct sk_buff *skb);
 extern void	       __kfree_skb(struct sk_buff *skb);
 extern struct sk_buff *__alloc_skb(unsigned int size,
 				   gfp_t priority, int fclone, int node);
+extern struct sk_buff *build_skb(void *data, unsigned int frag_size);
 static inline struct sk_buff *alloc_skb(unsigned int size,
 					gfp_t priority)
 {
@@ -1492,6 +1495,28 @@ static inline struct sk_buff *__dev_alloc_skb(unsigned int length,
 
 extern struct sk_buff *dev_alloc_skb(unsigned int length);
 
+extern void *netdev_alloc_frag(unsigned int fragsz);
+
+/**
+ *	netdev_free_frag - release a buffer from netdev_alloc_frag()
+ *	@data: fragment start
+ *
+ *	Only needed for fragments that never made it into an skb, for
+ *	example when a receive ring is torn down.  Fragments owned by an
+ *	skb from build_skb() are released together with the skb.
+ */
+static inline void netdev_free_frag(void *data)
+{
+	put_page(virt_to_head_page(data));
+}
+
+/*
+ * Size of the buffer to request from netdev_alloc_frag() so that
+ * build_skb() can place @len bytes of data behind NET_SKB_PAD of headroom.
+ */
+#define SKB_FRAG_SIZE(len)	(SKB_DATA_ALIGN(NET_SKB_PAD + (len)) + \
+				 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+
 extern struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 		unsigned int length, gfp_t gfp_mask);
 
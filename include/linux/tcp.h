@@ -96,6 +96,7 @@ enum {
 #define TCP_QUICKACK		12	/* Block/reenable quick acks */
 #define TCP_CONGESTION		13	/* Congestion control algorithm */
 #define TCP_MD5SIG		14	/* TCP MD5 Signature (RFC2385) */
+#define TCP_ZEROCOPY_RECEIVE	35	/* Map receive queue pages to user */
 
 #define TCPI_OPT_TIMESTAMPS	1
 #define TCPI_OPT_SACK		2
@@ -170,10 +171,18 @@ struct tcp_md5sig {
 	__u8	tcpm_key[TCP_MD5SIG_MAXKEYLEN];		/* key (binary) */
 };
 
+/* for TCP_ZEROCOPY_RECEIVE socket option */
+struct tcp_zerocopy_receive {
+	__u64 address;		/* in: address of mapping */
+	__u32 length;		/* in/out: number of bytes to map/mapped */
+	__u32 recv_skip_hint;	/* out: amount of bytes to skip */
+};
+
 #ifdef __KERNEL__
 
 #include <linux/skbuff.h>
 #include <linux/dmaengine.h>
+#include <linux/hrtimer.h>
 #include <net/sock.h>
 #include <net/inet_connection_sock.h>
 #include <net/inet_timewait_sock.h>
@@ -406,6 +415,17 @@ struct tcp_sock {
 /* TCP MD5 Signature Option information */
 	struct tcp_md5sig_info	*md5sig_info;
 #endif
+
+/* TCP Small Queues and pacing */
+	unsigned long		tsq_flags;
+	struct list_head	tsq_node;	/* anchor in tsq_tasklet.head list */
+	struct hrtimer		pacing_timer;
+};
+
+enum tsq_flags {
+	TSQ_THROTTLED,	/* waiting for skbs to leave the qdisc/device */
+	TSQ_QUEUED,	/* queued to the per-cpu tsq tasklet */
+	TSQ_OWNED,	/* tcp_tasklet_func() found socket was owned */
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
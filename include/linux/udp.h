@@ -38,6 +38,7 @@ struct udphdr {
 #ifdef __KERNEL__
 #include <net/inet_sock.h>
 #include <linux/skbuff.h>
+#include <linux/jhash.h>
 #include <net/netns/hash.h>
 
 static inline struct udphdr *udp_hdr(const struct sk_buff *skb)
@@ -52,6 +53,13 @@ static inline int udp_hashfn(struct net *net, const unsigned num)
 	return (num + net_hash_mix(net)) & (UDP_HTABLE_SIZE - 1);
 }
 
+static inline int udp_portaddr_hashfn(struct net *net, __be32 addr,
+				      const unsigned num)
+{
+	return (jhash_1word((__force u32)addr, net_hash_mix(net)) ^ num) &
+	       (UDP_HTABLE_SIZE - 1);
+}
+
 struct udp_sock {
 	/* inet_sock has to be the first member */
 	struct inet_sock inet;
@@ -78,6 +86,12 @@ struct udp_sock {
 	 * For encapsulation sockets.
 	 */
 	int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
+	/*
+	 * Secondary (local address, local port) hash, used to deliver
+	 * multicast and broadcast datagrams.
+	 */
+	struct hlist_node udp_portaddr_node;
+	unsigned int	 udp_portaddr_hash;
 };
 
 static inline struct udp_sock *udp_sk(const struct sock *sk)
@@ -0,0 +1,89 @@
+#ifndef __LINUX_ZCACHE_H
+#define __LINUX_ZCACHE_H
+/*
+ * Compressed cache for clean page cache pages.
+ *
+ * Clean pages that reclaim drops from the page cache of a filesystem
+ * which sets FS_ZCACHE are kept LZO compressed in a bounded pool, and
+ * handed back by the filesystem's ->readpage before it goes to the media.
+ */
+
+#include <linux/fs.h>
+#include <linux/mm_types.h>
+
+#ifdef CONFIG_ZCACHE
+extern unsigned long zcache_max_kbytes;
+
+int zcache_max_kbytes_handler(struct ctl_table *table, int write,
+			      void __user *buffer, size_t *lenp, loff_t *ppos);
+
+void __zcache_put_page(struct page *page);
+int __zcache_get_page(struct page *page);
+void __zcache_flush_inode(struct address_space *mapping);
+void zcache_flush_fs(struct super_block *sb);
+
+static inline int zcache_mapping_enabled(struct address_space *mapping)
+{
+	struct inode *inode = mapping->host;
+
+	return zcache_max_kbytes && inode &&
+		(inode->i_sb->s_type->fs_flags & FS_ZCACHE);
+}
+
+/*
+ * Called under mapping->tree_lock, with interrupts disabled, just before
+ * a clean page is taken out of the page cache by reclaim.
+ */
+static inline void zcache_put_page(struct page *page)
+{
+	if (zcache_mapping_enabled(page->mapping))
+		__zcache_put_page(page);
+}
+
+/*
+ * Called by ->readpage on a locked page.  Returns 0 and fills in the
+ * page if it was found in the cache; the cached copy is dropped.
+ */
+static inline int zcache_get_page(struct page *page)
+{
+	if (zcache_mapping_enabled(page->mapping))
+		return __zcache_get_page(page);
+	return -1;
+}
+
+/*
+ * Forget everything cached for an inode whose contents are going away.
+ * An inode that is merely being evicted from the inode cache keeps its
+ * compressed pages, so that they can be found again by the next iget.
+ */
+static inline void zcache_flush_inode(struct address_space *mapping)
+{
+	struct inode *inode = mapping->host;
+
+	if (!zcache_mapping_enabled(mapping))
+		return;
+	if ((inode->i_state & (I_FREEING | I_CLEAR)) && inode->i_nlink)
+		return;
+	__zcache_flush_inode(mapping);
+}
+#else  /* !CONFIG_ZCACHE */
+
+static inline void zcache_put_page(struct page *page)
+{
+}
+
+static inline int zcache_get_page(struct page *page)
+{
+	return -1;
+}
+
+static inline void zcache_flush_inode(struct address_space *mapping)
+{
+}
+
+static inline void zcache_flush_fs(struct super_block *sb)
+{
+}
+#endif /* !CONFIG_ZCACHE */
+
+#endif /* __LINUX_ZCACHE_H */
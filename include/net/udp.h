@@ -54,8 +54,19 @@ struct udp_hslot {
 	struct hlist_nulls_head	head;
 	spinlock_t		lock;
 } __attribute__((aligned(2 * sizeof(long))));
+
+/*
+ * Sockets hashed on (local address, local port).  Only walked under
+ * the slot lock, so a plain hlist is enough.
+ */
+struct udp_hslot2 {
+	struct hlist_head	head;
+	spinlock_t		lock;
+} __attribute__((aligned(2 * sizeof(long))));
+
 struct udp_table {
 	struct udp_hslot	hash[UDP_HTABLE_SIZE];
+	struct udp_hslot2	hash2[UDP_HTABLE_SIZE];
 };
 extern struct udp_table udp_table;
 extern void udp_table_init(struct udp_table *);
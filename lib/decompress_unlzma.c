@@ -38,6 +38,16 @@
 
 #include <linux/decompress/mm.h>
 
+#ifndef PREBOOT
+/*
+ * Besides the initramfs unpacker, unlzma() is used at runtime by
+ * filesystems (squashfs), so it must not be discarded with init memory.
+ */
+#include <linux/module.h>
+#undef INIT
+#define INIT
+#endif
+
 #define	MIN(a, b) (((a) < (b)) ? (a) : (b))
 
 static long long INIT read_int(unsigned char *ptr, int size)
@@ -308,6 +318,11 @@ static inline uint8_t INIT peek_old_byte(struct writer *wr,
 		int32_t pos;
 		while (offs > wr->header->dict_size)
 			offs -= wr->header->dict_size;
+		if (offs > wr->buffer_pos) {
+			/* corrupt stream: match distance before the output */
+			error("bad match distance");
+			return 0;
+		}
 		pos = wr->buffer_pos - offs;
 		return wr->buffer[pos];
 	} else {
@@ -664,4 +679,7 @@ STATIC int INIT decompress(unsigned char *buf, int in_len,
 {
 	return unlzma(buf, in_len - 4, fill, flush, output, posp, error_fn);
 }
+#else
+EXPORT_SYMBOL(unlzma);
+MODULE_LICENSE("GPL");
 #endif
@@ -214,12 +214,36 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t read_ahead_adaptive_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned long adaptive;
+	ssize_t ret = -EINVAL;
+
+	adaptive = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0')) &&
+	    adaptive <= 1) {
+		bdi->ra_adaptive = adaptive;
+		ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(read_ahead_adaptive, bdi->ra_adaptive)
+
+BDI_SHOW(read_throughput_kb, bdi_read_throughput(bdi))
+BDI_SHOW(read_latency_us, bdi_read_latency(bdi))
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(read_ahead_adaptive),
+	__ATTR_RO(read_throughput_kb),
+	__ATTR_RO(read_latency_us),
 	__ATTR_NULL,
 };
 
@@ -657,6 +681,11 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = PROP_FRAC_BASE;
+	bdi->ra_adaptive = 0;
+	bdi->read_bytes_avg = 0;
+	bdi->read_usecs_avg = 0;
+	bdi->ra_initial = 0;
+	bdi->ra_initial_hits = 0;
 	spin_lock_init(&bdi->wb_lock);
 	INIT_RCU_HEAD(&bdi->rcu_head);
 	INIT_LIST_HEAD(&bdi->bdi_list);
@@ -690,6 +719,71 @@ err:
 }
 EXPORT_SYMBOL(bdi_init);
 
+/*
+ * Weight of a new sample in the read statistics: 1/2^BDI_READ_AVG_SHIFT.
+ * The averages are stored multiplied by 2^BDI_READ_AVG_SHIFT, as srtt is
+ * in TCP, so small samples are not rounded away.
+ */
+#define BDI_READ_AVG_SHIFT	3
+
+static unsigned long bdi_read_avg(unsigned long avg, unsigned long sample,
+				  int first)
+{
+	if (first)
+		return sample << BDI_READ_AVG_SHIFT;
+	return avg - (avg >> BDI_READ_AVG_SHIFT) + sample;
+}
+
+/**
+ * bdi_account_read - feed a completed read into the bdi statistics
+ * @bdi: the device read from
+ * @bytes: size of the read
+ * @usecs: time from submission to completion
+ *
+ * Called by drivers and filesystems as reads complete.  The time may have
+ * jiffy granularity where nothing better is at hand: the start of a read
+ * falls at a random point of a tick, so the average is still right even
+ * if most samples are 0 or one tick.  May be called from interrupt
+ * context.
+ */
+void bdi_account_read(struct backing_dev_info *bdi, unsigned long bytes,
+		      unsigned long usecs)
+{
+	/* a zero read_bytes_avg means "no samples yet" */
+	int first = !bdi->read_bytes_avg;
+
+	if (!bytes)
+		return;
+	bdi->read_bytes_avg = bdi_read_avg(bdi->read_bytes_avg, bytes, first);
+	bdi->read_usecs_avg = bdi_read_avg(bdi->read_usecs_avg, usecs, first);
+}
+EXPORT_SYMBOL(bdi_account_read);
+
+/*
+ * Estimated read throughput of the device in kB/s, or 0 if it is not
+ * known yet.
+ */
+unsigned long bdi_read_throughput(struct backing_dev_info *bdi)
+{
+	unsigned long bytes = bdi->read_bytes_avg;
+	unsigned long usecs = bdi->read_usecs_avg;
+	u64 kbps;
+
+	if (!bytes)
+		return 0;
+	/* both are scaled alike; reads below the clock resolution count 1/8us */
+	kbps = div_u64((u64)bytes * (USEC_PER_SEC / 1024), usecs ?: 1);
+	return min_t(u64, kbps, ULONG_MAX);
+}
+
+/*
+ * Average read completion time of the device in microseconds.
+ */
+unsigned long bdi_read_latency(struct backing_dev_info *bdi)
+{
+	return bdi->read_usecs_avg >> BDI_READ_AVG_SHIFT;
+}
+
 void bdi_destroy(struct backing_dev_info *bdi)
 {
 	int i;
@@ -43,6 +43,14 @@
  * 			LMI_SYS|audio:0x05000000:\
  * 			bigphyarea:5M
  *
+ * With CONFIG_CMA, partitions in low memory are not wasted while their
+ * drivers are idle: they are handed to the page allocator as MIGRATE_CMA
+ * pageblocks, which only movable pages (page cache, anonymous memory) may
+ * use. bpa2_alloc_pages() migrates those pages away before returning the
+ * range, so it may sleep on such partitions. To keep free buddy pages from
+ * straddling the partition boundaries, its base and size must be aligned
+ * to BPA2_CMA_ALIGN; dynamically placed partitions are rounded up to it.
+ *
  *   This program is free software; you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
  *   the Free Software Foundation; either version 2 of the License, or
@@ -72,6 +80,7 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/pfn.h>
+#include <linux/mutex.h>
 #include <linux/bpa2.h>
 
 
@@ -80,6 +89,11 @@
 #define BPA2_RES_PREFIX "bpa2:"
 #define BPA2_RES_PREFIX_LEN 5
 
+#ifdef CONFIG_CMA
+#define BPA2_CMA_ALIGN (PAGE_SIZE << max_t(unsigned long, MAX_ORDER - 1, \
+						pageblock_order))
+#endif
+
 
 
 struct bpa2_range {
@@ -99,6 +113,7 @@ struct bpa2_part {
 	struct bpa2_range *used_list;
 	int flags;
 	int low_mem;
+	int cma; /* memory lent to the page allocator */
 	struct list_head list;
 	int names_cnt;
 	/* Do not separate two following fields! */
@@ -111,6 +126,10 @@ struct bpa2_part {
 static LIST_HEAD(bpa2_parts);
 static struct bpa2_part *bpa2_bigphysarea_part;
 static DEFINE_SPINLOCK(bpa2_lock);
+#ifdef CONFIG_CMA
+/* Serialises claiming lent ranges back from the page allocator */
+static DEFINE_MUTEX(bpa2_cma_mutex);
+#endif
 
 
 
@@ -149,7 +168,11 @@ static int bpa2_check_name(struct bpa2_part *part, const char *name)
 static int __init bpa2_alloc_low(struct bpa2_part *part, unsigned long size,
 		unsigned long *start)
 {
+#ifdef CONFIG_CMA
+	void *addr = __alloc_bootmem_low(size, BPA2_CMA_ALIGN, 0);
+#else
 	void *addr = alloc_bootmem_low_pages(size);
+#endif
 
 	if (addr == NULL) {
 		printk(KERN_ERR "bpa2: could not allocate low memory\n");
@@ -219,6 +242,12 @@ static int __init bpa2_add_part(const char **names, int names_cnt,
 		size = PAGE_ALIGN(size);
 	}
 
+#ifdef CONFIG_CMA
+	/* The memory is lent to the page allocator, rounding up is free */
+	if (start == 0)
+		size = ALIGN(size, BPA2_CMA_ALIGN);
+#endif
+
 	part->flags = flags;
 	part->names_cnt = names_cnt;
 
@@ -256,6 +285,12 @@ static int __init bpa2_add_part(const char **names, int names_cnt,
 		goto fail;
 	}
 
+#ifdef CONFIG_CMA
+	/* Activated by bpa2_cma_init() once the page allocator is up */
+	part->cma = part->low_mem && IS_ALIGNED(start, BPA2_CMA_ALIGN) &&
+			IS_ALIGNED(size, BPA2_CMA_ALIGN);
+#endif
+
 	/* Initialize ranges */
 	part->initial_free_list.next = NULL;
 	part->initial_free_list.base = start;
@@ -431,6 +466,72 @@ static int __init bpa2_parts_setup(char *str)
 }
 __setup("bpa2parts=", bpa2_parts_setup);
 
+#ifdef CONFIG_CMA
+/*
+ * Hand the boot-time reserved memory of the eligible partitions over to
+ * the page allocator. A partition must sit in a single zone without
+ * holes, otherwise it stays carved out.
+ */
+static int __init bpa2_cma_init(void)
+{
+	struct bpa2_part *part;
+
+	list_for_each_entry(part, &bpa2_parts, list) {
+		unsigned long start_pfn = PFN_DOWN(part->res.start);
+		unsigned long end_pfn = PFN_DOWN(part->res.end + 1);
+		unsigned long pfn;
+		struct zone *zone = NULL;
+
+		if (!part->cma)
+			continue;
+
+		for (pfn = start_pfn; pfn < end_pfn; pfn++) {
+			if (!pfn_valid(pfn))
+				break;
+			if (!zone)
+				zone = page_zone(pfn_to_page(pfn));
+			else if (page_zone(pfn_to_page(pfn)) != zone)
+				break;
+		}
+		if (pfn < end_pfn) {
+			printk(KERN_WARNING "bpa2: '%s' partition spans "
+					"several zones - not lent\n",
+					bpa2_get_name(part, 0));
+			part->cma = 0;
+			continue;
+		}
+
+		for (pfn = start_pfn; pfn < end_pfn; pfn += pageblock_nr_pages)
+			init_cma_reserved_pageblock(pfn_to_page(pfn));
+
+		printk(KERN_INFO "bpa2: partition '%s' lent to the page "
+				"allocator\n", bpa2_get_name(part, 0));
+	}
+
+	return 0;
+}
+core_initcall(bpa2_cma_init);
+
+/*
+ * Claim [base, base + count pages) back from the page allocator.
+ * Called with bpa2_cma_mutex held.
+ */
+static int bpa2_cma_claim(struct bpa2_part *part, unsigned long base,
+		int count)
+{
+	unsigned long pfn = PFN_DOWN(base);
+	int ret;
+
+	ret = alloc_contig_range(pfn, pfn + count);
+	if (ret)
+		printk(KERN_WARNING "bpa2: could not claim %d pages at "
+				"0x%08lx from '%s' partition (%d)\n", count,
+				base, bpa2_get_name(part, 0), ret);
+
+	return ret;
+}
+#endif
+
 
 
 /**
@@ -472,6 +573,9 @@ EXPORT_SYMBOL(bpa2_low_part);
 
 
 
+static unsigned long __bpa2_free_range(struct bpa2_part *part,
+		unsigned long base);
+
 /**
  * __bpa2_alloc_pages - allocate pages from a bpa2 partition
  * @part: partition to allocate from
@@ -484,7 +588,8 @@ EXPORT_SYMBOL(bpa2_low_part);
  * is used for partition management information, it does not influence the
  * memory returned.
  *
- * This function may not be called from an interrupt.
+ * This function may not be called from an interrupt. If the partition
+ * is lent to the page allocator (CONFIG_CMA) it may also sleep.
  */
 unsigned long __bpa2_alloc_pages(struct bpa2_part *part, int count, int align,
 		int priority, const char *trace_file, int trace_line)
@@ -510,6 +615,10 @@ unsigned long __bpa2_alloc_pages(struct bpa2_part *part, int count, int align,
 	else
 		align = align * PAGE_SIZE;
 
+#ifdef CONFIG_CMA
+	if (part->cma)
+		mutex_lock(&bpa2_cma_mutex);
+#endif
 	spin_lock(&bpa2_lock);
 
 	/* Search a free block which is large enough, even with alignment. */
@@ -565,6 +674,15 @@ unsigned long __bpa2_alloc_pages(struct bpa2_part *part, int count, int align,
 
 fail_unlock:
 	spin_unlock(&bpa2_lock);
+#ifdef CONFIG_CMA
+	if (part->cma) {
+		if (result && bpa2_cma_claim(part, result, count) != 0) {
+			__bpa2_free_range(part, result);
+			result = 0;
+		}
+		mutex_unlock(&bpa2_cma_mutex);
+	}
+#endif
 fail:
 	if (new_range)
 		kfree(new_range);
@@ -575,20 +693,15 @@ fail:
 }
 EXPORT_SYMBOL(__bpa2_alloc_pages);
 
-/**
- * bpa2_free_pages - free pages allocated from a bpa2 partition
- * @part: partition to free pages back to
- * @base:
- * @align: required alinment
- * @priority: GFP_* flags to use
- *
- * Free pages allocated with `bigphysarea_alloc_pages'. `base' must be an
- * address returned by `bigphysarea_alloc_pages'.
- * This function my not be called from an interrupt!
+/*
+ * Return the range starting at `base' to the partition's free list.
+ * Returns the size of the range, or 0 if it was not allocated.
  */
-void bpa2_free_pages(struct bpa2_part *part, unsigned long base)
+static unsigned long __bpa2_free_range(struct bpa2_part *part,
+		unsigned long base)
 {
 	struct bpa2_range *prev, *next, *range, **range_ptr;
+	unsigned long size;
 
 	spin_lock(&bpa2_lock);
 
@@ -602,9 +715,10 @@ void bpa2_free_pages(struct bpa2_part *part, unsigned long base)
 		printk(KERN_ERR "%s: 0x%08lx not allocated!\n",
 				__func__, base);
 		spin_unlock(&bpa2_lock);
-		return;
+		return 0;
 	}
 	range = *range_ptr;
+	size = range->size;
 
 	/* Remove range from the used list: */
 	*range_ptr = (*range_ptr)->next;
@@ -643,6 +757,34 @@ void bpa2_free_pages(struct bpa2_part *part, unsigned long base)
 		kfree(next);
 	if (range && (range != &part->initial_free_list))
 		kfree(range);
+
+	return size;
+}
+
+/**
+ * bpa2_free_pages - free pages allocated from a bpa2 partition
+ * @part: partition to free pages back to
+ * @base: physical address returned by bpa2_alloc_pages()
+ *
+ * Free pages allocated with `bpa2_alloc_pages'. `base' must be an
+ * address returned by `bpa2_alloc_pages'.
+ * This function my not be called from an interrupt!
+ */
+void bpa2_free_pages(struct bpa2_part *part, unsigned long base)
+{
+#ifdef CONFIG_CMA
+	if (part->cma) {
+		unsigned long size;
+
+		mutex_lock(&bpa2_cma_mutex);
+		size = __bpa2_free_range(part, base);
+		if (size)
+			free_contig_range(PFN_DOWN(base), size >> PAGE_SHIFT);
+		mutex_unlock(&bpa2_cma_mutex);
+		return;
+	}
+#endif
+	__bpa2_free_range(part, base);
 }
 EXPORT_SYMBOL(bpa2_free_pages);
 
@@ -731,6 +873,10 @@ static int bpa2_seq_show(struct seq_file *s, void *v)
 	seq_printf(s, "Size: %d kB, base address: 0x%08x\n",
 			(part->res.end - part->res.start + 1) / 1024,
 			part->res.start);
+#ifdef CONFIG_CMA
+	if (part->cma)
+		seq_printf(s, "Free memory lent to the page allocator\n");
+#endif
 	seq_printf(s, "Statistics:                  free       "
 			"    used\n");
 	seq_printf(s, "- number of blocks:      %8d       %8d\n",
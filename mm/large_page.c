@@ -0,0 +1,759 @@
+/*
+ * Transparent large pages for anonymous memory.
+ *
+ * Architectures such as SH-4 can map a naturally aligned group of small
+ * pages with one large TLB entry, provided the group is physically
+ * contiguous and all of its ptes agree.  This code makes such groups
+ * common without changing how the rest of mm sees anonymous memory:
+ *
+ *  - a write fault into an empty, suitably aligned part of a private
+ *    anonymous vma populates the whole group from one high order
+ *    allocation, split into ordinary order-0 pages;
+ *
+ *  - the "klargepaged" thread walks the mms that use large pages and
+ *    copies groups that have become (or never were) scattered into a
+ *    fresh contiguous block.
+ *
+ * The large TLB entry itself is purely an architecture matter, decided
+ * at refill time from the ptes.  Anything that changes a pte of a group
+ * (reclaim, migration, mprotect, COW, munmap) flushes it and so simply
+ * splits the group back into small TLB entries until the collapser
+ * repairs it.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/highmem.h>
+#include <linux/memcontrol.h>
+#include <linux/mmu_notifier.h>
+#include <linux/large_page.h>
+
+#include <asm/tlbflush.h>
+#include <asm/pgtable.h>
+
+/* Areas whose pages must keep their own identity, or cannot be moved */
+#define VM_NO_LARGE_PAGE	(VM_SHARED | VM_MAYSHARE | VM_GROWSDOWN |    \
+				 VM_GROWSUP | VM_PFNMAP | VM_IO |	     \
+				 VM_MIXEDMAP | VM_HUGETLB | VM_NONLINEAR |   \
+				 VM_INSERTPAGE | VM_RESERVED | VM_MERGEABLE)
+
+/**
+ * struct mm_slot - collapser information per mm that is being scanned
+ * @link: link to the mm_slots hash list
+ * @mm_list: link into the mm_slots list, rooted in large_page_mm_head
+ * @mm: the mm that this information is valid for
+ */
+struct mm_slot {
+	struct hlist_node link;
+	struct list_head mm_list;
+	struct mm_struct *mm;
+};
+
+/**
+ * struct large_page_scan - cursor for scanning
+ * @mm_slot: the current mm_slot we are scanning
+ * @address: the next address inside that to be scanned
+ * @seqnr: count of completed full scans
+ *
+ * There is only the one large_page_scan instance of this cursor structure.
+ */
+struct large_page_scan {
+	struct mm_slot *mm_slot;
+	unsigned long address;
+	unsigned long seqnr;
+};
+
+#define MM_SLOTS_HASH_HEADS 1024
+static struct hlist_head *mm_slots_hash;
+
+static struct mm_slot large_page_mm_head = {
+	.mm_list = LIST_HEAD_INIT(large_page_mm_head.mm_list),
+};
+static struct large_page_scan large_page_scan = {
+	.mm_slot = &large_page_mm_head,
+};
+
+static struct kmem_cache *mm_slot_cache;
+
+/* Whether faults allocate large pages and the collapser runs */
+static unsigned int large_page_enabled = 1;
+
+/* Number of pages the collapser looks at before sleeping */
+static unsigned int large_page_pages_to_scan = 4096;
+
+/* Milliseconds the collapser sleeps between scans */
+static unsigned int large_page_sleep_millisecs = 10000;
+
+/* The number of groups collapsed into large pages */
+static unsigned long large_page_pages_collapsed;
+
+static DECLARE_WAIT_QUEUE_HEAD(large_page_wait);
+static DEFINE_SPINLOCK(large_page_mmlist_lock);
+
+static inline struct mm_slot *alloc_mm_slot(void)
+{
+	if (!mm_slot_cache)	/* initialization failed */
+		return NULL;
+	return kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+}
+
+static inline void free_mm_slot(struct mm_slot *mm_slot)
+{
+	kmem_cache_free(mm_slot_cache, mm_slot);
+}
+
+static struct hlist_head *mm_slots_bucket(struct mm_struct *mm)
+{
+	return &mm_slots_hash[((unsigned long)mm / sizeof(struct mm_struct))
+			      % MM_SLOTS_HASH_HEADS];
+}
+
+static struct mm_slot *get_mm_slot(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(mm_slot, node, mm_slots_bucket(mm), link) {
+		if (mm == mm_slot->mm)
+			return mm_slot;
+	}
+	return NULL;
+}
+
+static inline bool large_page_test_exit(struct mm_struct *mm)
+{
+	return atomic_read(&mm->mm_users) == 0;
+}
+
+static inline bool large_page_vma_suitable(struct vm_area_struct *vma,
+					   unsigned long haddr)
+{
+	if (vma->vm_ops || (vma->vm_flags & VM_NO_LARGE_PAGE))
+		return false;
+	return haddr >= vma->vm_start && haddr + LARGE_PAGE_SIZE <= vma->vm_end;
+}
+
+static pmd_t *large_page_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd))
+		return NULL;
+	return pmd;
+}
+
+/*
+ * Allocate a naturally aligned block for one group, split into order-0
+ * pages and charged to @mm.
+ */
+static struct page *large_page_alloc(struct mm_struct *mm, gfp_t gfp_mask)
+{
+	struct page *page;
+	int i;
+
+	page = alloc_pages(gfp_mask | __GFP_NOWARN, LARGE_PAGE_ORDER);
+	if (!page)
+		return NULL;
+	split_page(page, LARGE_PAGE_ORDER);
+
+	for (i = 0; i < LARGE_PAGE_NR; i++) {
+		if (mem_cgroup_newpage_charge(page + i, mm, GFP_KERNEL))
+			goto uncharge;
+	}
+	return page;
+
+uncharge:
+	while (--i >= 0)
+		mem_cgroup_uncharge_page(page + i);
+	for (i = 0; i < LARGE_PAGE_NR; i++)
+		__free_page(page + i);
+	return NULL;
+}
+
+static void large_page_free(struct page *page)
+{
+	int i;
+
+	for (i = 0; i < LARGE_PAGE_NR; i++) {
+		mem_cgroup_uncharge_page(page + i);
+		put_page(page + i);
+	}
+}
+
+/**
+ * large_page_fault - populate a whole group on an anonymous write fault
+ * @mm: the faulting mm
+ * @vma: the private anonymous vma, with its anon_vma already prepared
+ * @address: the faulting address
+ * @pmd: the pmd covering @address
+ *
+ * Called from do_anonymous_page() with mmap_sem held for read and the
+ * page table unlocked.  Returns 1 if the group around @address has been
+ * mapped, 0 if the caller should fall back to a single small page.
+ */
+int large_page_fault(struct mm_struct *mm, struct vm_area_struct *vma,
+		     unsigned long address, pmd_t *pmd)
+{
+	unsigned long haddr = address & LARGE_PAGE_MASK;
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *pte;
+	int i;
+
+	if (!large_page_enabled || !large_page_vma_suitable(vma, haddr))
+		return 0;
+
+	if (unlikely(!test_bit(MMF_VM_LARGE_PAGE, &mm->flags)))
+		__large_page_enter(mm);
+
+	/* Only ever fill groups that are still entirely empty */
+	pte = pte_offset_map(pmd, haddr);
+	for (i = 0; i < LARGE_PAGE_NR; i++)
+		if (!pte_none(pte[i]))
+			break;
+	pte_unmap(pte);
+	if (i < LARGE_PAGE_NR)
+		return 0;
+
+	page = large_page_alloc(mm, GFP_HIGHUSER_MOVABLE | __GFP_NORETRY);
+	if (!page) {
+		count_vm_event(TLP_FAULT_FALLBACK);
+		return 0;
+	}
+
+	for (i = 0; i < LARGE_PAGE_NR; i++) {
+		clear_user_highpage(page + i, haddr + i * PAGE_SIZE);
+		__SetPageUptodate(page + i);
+	}
+
+	pte = pte_offset_map_lock(mm, pmd, haddr, &ptl);
+	for (i = 0; i < LARGE_PAGE_NR; i++)
+		if (!pte_none(pte[i]))
+			goto release;
+
+	for (i = 0; i < LARGE_PAGE_NR; i++) {
+		unsigned long addr = haddr + i * PAGE_SIZE;
+		pte_t entry;
+
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+		page_add_new_anon_rmap(page + i, vma, addr);
+		set_pte_at(mm, addr, pte + i, entry);
+	}
+	add_mm_counter(mm, anon_rss, LARGE_PAGE_NR);
+
+	/* No need to invalidate - it was non-present before */
+	i = (address - haddr) >> PAGE_SHIFT;
+	update_mmu_cache(vma, address, pte[i]);
+	pte_unmap_unlock(pte, ptl);
+
+	count_vm_event(TLP_FAULT_ALLOC);
+	return 1;
+
+release:
+	pte_unmap_unlock(pte, ptl);
+	large_page_free(page);
+	count_vm_event(TLP_FAULT_FALLBACK);
+	return 0;
+}
+
+/*
+ * A group is worth collapsing when all of its ptes map anonymous pages
+ * used by nobody but this mm, with the same write permission, and they
+ * are not a large page already.  Called with the page table locked; the
+ * pages are returned through @pages when it is not NULL.
+ */
+static int large_page_collapsible(struct vm_area_struct *vma,
+				  unsigned long haddr, pte_t *pte,
+				  struct page **pages)
+{
+	unsigned long pfn = pte_pfn(pte[0]);
+	int contiguous = !(pfn & (LARGE_PAGE_NR - 1));
+	int i;
+
+	for (i = 0; i < LARGE_PAGE_NR; i++) {
+		pte_t entry = pte[i];
+		struct page *page;
+
+		if (!pte_present(entry) || pte_write(entry) != pte_write(pte[0]))
+			return 0;
+		page = vm_normal_page(vma, haddr + i * PAGE_SIZE, entry);
+		if (!page || !PageAnon(page) || !PageLRU(page))
+			return 0;
+		/* Not shared, not in swap cache, not pinned */
+		if (page_mapcount(page) != 1 || page_count(page) != 1)
+			return 0;
+		if (pte_pfn(entry) != pfn + i)
+			contiguous = 0;
+		if (pages)
+			pages[i] = page;
+	}
+	return !contiguous;
+}
+
+static int large_page_scan_group(struct mm_struct *mm,
+				 struct vm_area_struct *vma,
+				 unsigned long haddr)
+{
+	spinlock_t *ptl;
+	pmd_t *pmd;
+	pte_t *pte;
+	int ret;
+
+	pmd = large_page_find_pmd(mm, haddr);
+	if (!pmd)
+		return 0;
+
+	pte = pte_offset_map_lock(mm, pmd, haddr, &ptl);
+	ret = large_page_collapsible(vma, haddr, pte, NULL);
+	pte_unmap_unlock(pte, ptl);
+
+	return ret;
+}
+
+/*
+ * Copy the group at @haddr into a freshly allocated contiguous block.
+ * The new block is allocated before taking mmap_sem for write, so that
+ * any reclaim it needs does not stall faults on this mm.
+ */
+static void large_page_collapse(struct mm_struct *mm, unsigned long haddr)
+{
+	struct page *old[LARGE_PAGE_NR];
+	struct vm_area_struct *vma;
+	struct page *new;
+	spinlock_t *ptl;
+	pmd_t *pmd;
+	pte_t *pte;
+	int i, write;
+
+	new = large_page_alloc(mm, GFP_HIGHUSER_MOVABLE);
+	if (!new) {
+		count_vm_event(TLP_COLLAPSE_ALLOC_FAILED);
+		return;
+	}
+	count_vm_event(TLP_COLLAPSE_ALLOC);
+
+	down_write(&mm->mmap_sem);
+	if (large_page_test_exit(mm))
+		goto out;
+	vma = find_vma(mm, haddr);
+	if (!vma || !vma->anon_vma || !large_page_vma_suitable(vma, haddr))
+		goto out;
+	pmd = large_page_find_pmd(mm, haddr);
+	if (!pmd)
+		goto out;
+
+	mmu_notifier_invalidate_range_start(mm, haddr, haddr + LARGE_PAGE_SIZE);
+	pte = pte_offset_map_lock(mm, pmd, haddr, &ptl);
+	if (!large_page_collapsible(vma, haddr, pte, old)) {
+		pte_unmap_unlock(pte, ptl);
+		mmu_notifier_invalidate_range_end(mm, haddr,
+						  haddr + LARGE_PAGE_SIZE);
+		goto out;
+	}
+	write = pte_write(pte[0]);
+
+	/* Take the group away from the user before copying it */
+	flush_cache_range(vma, haddr, haddr + LARGE_PAGE_SIZE);
+	for (i = 0; i < LARGE_PAGE_NR; i++)
+		ptep_get_and_clear(mm, haddr + i * PAGE_SIZE, pte + i);
+	flush_tlb_range(vma, haddr, haddr + LARGE_PAGE_SIZE);
+
+	for (i = 0; i < LARGE_PAGE_NR; i++) {
+		unsigned long addr = haddr + i * PAGE_SIZE;
+		pte_t entry;
+
+		copy_user_highpage(new + i, old[i], addr, vma);
+		__SetPageUptodate(new + i);
+
+		entry = pte_mkdirty(mk_pte(new + i, vma->vm_page_prot));
+		if (write)
+			entry = pte_mkwrite(entry);
+		page_add_new_anon_rmap(new + i, vma, addr);
+		set_pte_at(mm, addr, pte + i, entry);
+
+		page_remove_rmap(old[i]);
+		put_page(old[i]);
+	}
+	pte_unmap_unlock(pte, ptl);
+	mmu_notifier_invalidate_range_end(mm, haddr, haddr + LARGE_PAGE_SIZE);
+
+	large_page_pages_collapsed++;
+	new = NULL;
+out:
+	up_write(&mm->mmap_sem);
+	if (new)
+		large_page_free(new);
+}
+
+/*
+ * Scan the mm under the cursor for at most @pages pages, collapsing at
+ * most one group.  Returns the number of pages accounted as scanned.
+ */
+static unsigned int large_page_scan_mm(struct mm_slot *slot,
+				       unsigned int pages)
+{
+	struct mm_struct *mm = slot->mm;
+	struct vm_area_struct *vma;
+	unsigned int progress = 0;
+	unsigned long haddr;
+
+	down_read(&mm->mmap_sem);
+	if (large_page_test_exit(mm))
+		vma = NULL;
+	else
+		vma = find_vma(mm, large_page_scan.address);
+
+	for (; vma; vma = vma->vm_next) {
+		unsigned long start, end;
+
+		progress++;
+		if (!vma->anon_vma || vma->vm_ops ||
+		    (vma->vm_flags & VM_NO_LARGE_PAGE))
+			continue;
+
+		start = ALIGN(vma->vm_start, LARGE_PAGE_SIZE);
+		end = vma->vm_end & LARGE_PAGE_MASK;
+		if (large_page_scan.address < start)
+			large_page_scan.address = start;
+
+		while (large_page_scan.address < end) {
+			if (large_page_test_exit(mm) || progress >= pages)
+				goto out;
+
+			haddr = large_page_scan.address;
+			large_page_scan.address += LARGE_PAGE_SIZE;
+			progress += LARGE_PAGE_NR;
+
+			if (large_page_scan_group(mm, vma, haddr)) {
+				up_read(&mm->mmap_sem);
+				large_page_collapse(mm, haddr);
+				return progress;
+			}
+			cond_resched();
+		}
+	}
+out:
+	up_read(&mm->mmap_sem);
+
+	/* Budget exhausted in the middle of this mm */
+	if (vma && !large_page_test_exit(mm))
+		return progress;
+
+	spin_lock(&large_page_mmlist_lock);
+	large_page_scan.mm_slot = list_entry(slot->mm_list.next,
+					     struct mm_slot, mm_list);
+	large_page_scan.address = 0;
+	if (large_page_scan.mm_slot == &large_page_mm_head)
+		large_page_scan.seqnr++;
+
+	if (large_page_test_exit(mm)) {
+		/*
+		 * __large_page_exit left this slot to us because the cursor
+		 * was on it: free it now that the cursor has moved on.
+		 */
+		hlist_del(&slot->link);
+		list_del(&slot->mm_list);
+		spin_unlock(&large_page_mmlist_lock);
+
+		free_mm_slot(slot);
+		clear_bit(MMF_VM_LARGE_PAGE, &mm->flags);
+		mmdrop(mm);
+	} else
+		spin_unlock(&large_page_mmlist_lock);
+
+	return progress ? progress : 1;
+}
+
+static void large_page_do_scan(unsigned int pages)
+{
+	unsigned int progress = 0;
+	struct mm_slot *slot;
+
+	/* Recently faulted pages are held by the lru pagevecs */
+	lru_add_drain();
+
+	while (progress < pages) {
+		cond_resched();
+
+		spin_lock(&large_page_mmlist_lock);
+		slot = large_page_scan.mm_slot;
+		if (slot == &large_page_mm_head) {
+			slot = list_entry(slot->mm_list.next,
+					  struct mm_slot, mm_list);
+			large_page_scan.mm_slot = slot;
+			large_page_scan.address = 0;
+		}
+		spin_unlock(&large_page_mmlist_lock);
+
+		/* A racing __large_page_exit may have emptied the list */
+		if (slot == &large_page_mm_head)
+			break;
+
+		progress += large_page_scan_mm(slot, pages - progress);
+	}
+}
+
+static int large_page_should_run(void)
+{
+	return large_page_enabled && !list_empty(&large_page_mm_head.mm_list);
+}
+
+static int large_page_scan_thread(void *nothing)
+{
+	set_user_nice(current, 19);
+
+	while (!kthread_should_stop()) {
+		if (large_page_should_run())
+			large_page_do_scan(large_page_pages_to_scan);
+
+		if (large_page_should_run()) {
+			schedule_timeout_interruptible(
+				msecs_to_jiffies(large_page_sleep_millisecs));
+		} else {
+			wait_event_interruptible(large_page_wait,
+				large_page_should_run() || kthread_should_stop());
+		}
+	}
+	return 0;
+}
+
+int __large_page_enter(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int needs_wakeup;
+
+	mm_slot = alloc_mm_slot();
+	if (!mm_slot)
+		return -ENOMEM;
+
+	spin_lock(&large_page_mmlist_lock);
+	if (test_and_set_bit(MMF_VM_LARGE_PAGE, &mm->flags)) {
+		/* A concurrent fault got here first */
+		spin_unlock(&large_page_mmlist_lock);
+		free_mm_slot(mm_slot);
+		return 0;
+	}
+	needs_wakeup = list_empty(&large_page_mm_head.mm_list);
+	mm_slot->mm = mm;
+	hlist_add_head(&mm_slot->link, mm_slots_bucket(mm));
+	/*
+	 * Insert just behind the scanning cursor, to let the area settle
+	 * down a little; when fork is followed by immediate exec, we don't
+	 * want to waste time scanning an mm that is about to go away.
+	 */
+	list_add_tail(&mm_slot->mm_list, &large_page_scan.mm_slot->mm_list);
+	spin_unlock(&large_page_mmlist_lock);
+
+	atomic_inc(&mm->mm_count);
+
+	if (needs_wakeup)
+		wake_up_interruptible(&large_page_wait);
+
+	return 0;
+}
+
+void __large_page_exit(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int easy_to_free = 0;
+
+	/*
+	 * This process is exiting: free its mm_slot now unless the cursor
+	 * is on it, in which case use mmap_sem to wait for any collapse in
+	 * progress before pagetables are freed, and leave the mm_slot on
+	 * the list for klargepaged to free.
+	 */
+	spin_lock(&large_page_mmlist_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && large_page_scan.mm_slot != mm_slot) {
+		hlist_del(&mm_slot->link);
+		list_del(&mm_slot->mm_list);
+		easy_to_free = 1;
+	}
+	spin_unlock(&large_page_mmlist_lock);
+
+	if (easy_to_free) {
+		free_mm_slot(mm_slot);
+		clear_bit(MMF_VM_LARGE_PAGE, &mm->flags);
+		mmdrop(mm);
+	} else if (mm_slot) {
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+#ifdef CONFIG_SYSFS
+/*
+ * This all compiles without CONFIG_SYSFS, but is a waste of space.
+ */
+
+#define LARGE_PAGE_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define LARGE_PAGE_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", large_page_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned long flags;
+	int err;
+
+	err = strict_strtoul(buf, 10, &flags);
+	if (err || flags > 1)
+		return -EINVAL;
+
+	large_page_enabled = flags;
+	if (flags)
+		wake_up_interruptible(&large_page_wait);
+
+	return count;
+}
+LARGE_PAGE_ATTR(enabled);
+
+static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", large_page_sleep_millisecs);
+}
+
+static ssize_t scan_sleep_millisecs_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	large_page_sleep_millisecs = msecs;
+
+	return count;
+}
+LARGE_PAGE_ATTR(scan_sleep_millisecs);
+
+static ssize_t pages_to_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", large_page_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long nr_pages;
+	int err;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || !nr_pages || nr_pages > UINT_MAX)
+		return -EINVAL;
+
+	large_page_pages_to_scan = nr_pages;
+
+	return count;
+}
+LARGE_PAGE_ATTR(pages_to_scan);
+
+static ssize_t pages_collapsed_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", large_page_pages_collapsed);
+}
+LARGE_PAGE_ATTR_RO(pages_collapsed);
+
+static ssize_t full_scans_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", large_page_scan.seqnr);
+}
+LARGE_PAGE_ATTR_RO(full_scans);
+
+static struct attribute *large_page_attrs[] = {
+	&enabled_attr.attr,
+	&scan_sleep_millisecs_attr.attr,
+	&pages_to_scan_attr.attr,
+	&pages_collapsed_attr.attr,
+	&full_scans_attr.attr,
+	NULL,
+};
+
+static struct attribute_group large_page_attr_group = {
+	.attrs = large_page_attrs,
+	.name = "transparent_large_page",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init large_page_init(void)
+{
+	struct task_struct *large_page_thread;
+	int err;
+
+	mm_slot_cache = kmem_cache_create("large_page_mm_slot",
+					  sizeof(struct mm_slot),
+					  __alignof__(struct mm_slot), 0, NULL);
+	if (!mm_slot_cache)
+		return -ENOMEM;
+
+	mm_slots_hash = kzalloc(MM_SLOTS_HASH_HEADS * sizeof(struct hlist_head),
+				GFP_KERNEL);
+	if (!mm_slots_hash) {
+		err = -ENOMEM;
+		goto out_free1;
+	}
+
+	large_page_thread = kthread_run(large_page_scan_thread, NULL,
+					"klargepaged");
+	if (IS_ERR(large_page_thread)) {
+		printk(KERN_ERR "large_page: creating kthread failed\n");
+		err = PTR_ERR(large_page_thread);
+		goto out_free2;
+	}
+
+#ifdef CONFIG_SYSFS
+	err = sysfs_create_group(mm_kobj, &large_page_attr_group);
+	if (err) {
+		printk(KERN_ERR "large_page: register sysfs failed\n");
+		kthread_stop(large_page_thread);
+		goto out_free2;
+	}
+#endif /* CONFIG_SYSFS */
+
+	return 0;
+
+out_free2:
+	kfree(mm_slots_hash);
+out_free1:
+	kmem_cache_destroy(mm_slot_cache);
+	mm_slot_cache = NULL;
+	return err;
+}
+module_init(large_page_init)
@@ -48,6 +48,9 @@
 #include <linux/page_cgroup.h>
 #include <linux/debugobjects.h>
 #include <linux/kmemleak.h>
+#include <linux/compaction.h>
+#include <linux/migrate.h>
+#include <linux/mm_inline.h>
 #include <trace/events/kmem.h>
 
 #include <asm/tlbflush.h>
@@ -568,6 +571,181 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	spin_unlock(&zone->lock);
 }
 
+#ifdef CONFIG_SMP
+/*
+ * Order-0 pages freed on a processor other than the one that allocated
+ * them are collected on the freeing processor's staged list, which only
+ * ever holds pages for one destination. Whole batches are then spliced
+ * onto the allocating processor's remote list, from which that processor
+ * refills its pcp-lists without taking zone->lock. A producer/consumer
+ * pair of processors thereby keeps cycling the same pages through their
+ * pcp-lists instead of through the buddy allocator.
+ */
+
+/*
+ * Move a list of order-0 pages with their migratetype in page_private
+ * onto the pcp-lists. Interrupts must be disabled.
+ */
+static void pcp_splice_pages(struct per_cpu_pages *pcp,
+			     struct list_head *list, int count)
+{
+	while (!list_empty(list)) {
+		struct page *page = list_entry(list->next, struct page, lru);
+		int migratetype = page_private(page);
+
+		if (migratetype >= MIGRATE_PCPTYPES)
+			migratetype = MIGRATE_MOVABLE;
+		list_move_tail(&page->lru, &pcp->lists[migratetype]);
+	}
+	pcp->count += count;
+}
+
+/*
+ * Free a list of order-0 pages with their migratetype in page_private
+ * to the buddy allocator.
+ */
+static void free_pages_list(struct zone *zone, struct list_head *list,
+			    int count)
+{
+	spin_lock(&zone->lock);
+	zone_clear_flag(zone, ZONE_ALL_UNRECLAIMABLE);
+	zone->pages_scanned = 0;
+
+	while (!list_empty(list)) {
+		struct page *page = list_entry(list->prev, struct page, lru);
+
+		list_del(&page->lru);
+		__free_one_page(page, zone, 0, page_private(page));
+		trace_mm_page_pcpu_drain(page, 0, page_private(page));
+	}
+	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
+	spin_unlock(&zone->lock);
+}
+
+/*
+ * Hand the staged batch over to its destination. If that processor has
+ * gone away or already has a full pcp-list worth of pages waiting, because
+ * it stopped allocating from this zone, keep the pages here instead.
+ */
+static void flush_staged_pages(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	struct per_cpu_pages *target = &zone_pcp(zone, pcp->staged_cpu)->pcp;
+	int count = pcp->staged_count;
+	int handed = 0;
+
+	pcp->staged_count = 0;
+	if (cpu_online(pcp->staged_cpu)) {
+		spin_lock(&target->remote_lock);
+		if (target->remote_count + count <= target->high) {
+			list_splice_init(&pcp->staged, &target->remote);
+			target->remote_count += count;
+			handed = 1;
+		}
+		spin_unlock(&target->remote_lock);
+	}
+
+	if (handed) {
+		__mod_zone_page_state(zone, PCP_REMOTE_FREE, count);
+		return;
+	}
+
+	pcp_splice_pages(pcp, &pcp->staged, count);
+	while (pcp->count >= pcp->high && pcp->count >= pcp->batch) {
+		free_pcppages_bulk(zone, pcp->batch, pcp);
+		pcp->count -= pcp->batch;
+	}
+}
+
+/*
+ * Stage an order-0 page for the processor that allocated it. Returns 0 if
+ * the page belongs on this processor's pcp-lists. Interrupts must be
+ * disabled.
+ */
+static int free_remote_page(struct zone *zone, struct per_cpu_pages *pcp,
+			    struct page *page, int cpu, int cold)
+{
+	int owner = page_alloc_cpu(page);
+
+	if (owner < 0 || owner == cpu || owner >= nr_cpu_ids ||
+	    !cpu_online(owner))
+		return 0;
+
+	if (pcp->staged_count && pcp->staged_cpu != owner)
+		flush_staged_pages(zone, pcp);
+
+	pcp->staged_cpu = owner;
+	if (cold)
+		list_add_tail(&page->lru, &pcp->staged);
+	else
+		list_add(&page->lru, &pcp->staged);
+	if (++pcp->staged_count >= pcp->batch)
+		flush_staged_pages(zone, pcp);
+	return 1;
+}
+
+/*
+ * Take the pages other processors handed back to us onto the pcp-lists.
+ * Interrupts must be disabled.
+ */
+static void refill_remote_pages(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	LIST_HEAD(pages);
+	int count;
+
+	if (!pcp->remote_count)
+		return;
+
+	spin_lock(&pcp->remote_lock);
+	list_splice_init(&pcp->remote, &pages);
+	count = pcp->remote_count;
+	pcp->remote_count = 0;
+	spin_unlock(&pcp->remote_lock);
+
+	pcp_splice_pages(pcp, &pages, count);
+	__mod_zone_page_state(zone, PCP_REMOTE_REFILL, count);
+}
+
+/*
+ * Return the remote and staged pages of a pcp to the buddy allocator.
+ * Interrupts must be disabled.
+ */
+static void drain_remote_pages(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	LIST_HEAD(pages);
+	int count;
+
+	spin_lock(&pcp->remote_lock);
+	list_splice_init(&pcp->remote, &pages);
+	count = pcp->remote_count;
+	pcp->remote_count = 0;
+	spin_unlock(&pcp->remote_lock);
+
+	list_splice_init(&pcp->staged, &pages);
+	count += pcp->staged_count;
+	pcp->staged_count = 0;
+
+	if (count)
+		free_pages_list(zone, &pages, count);
+}
+#else
+static inline int free_remote_page(struct zone *zone,
+				   struct per_cpu_pages *pcp,
+				   struct page *page, int cpu, int cold)
+{
+	return 0;
+}
+
+static inline void refill_remote_pages(struct zone *zone,
+				       struct per_cpu_pages *pcp)
+{
+}
+
+static inline void drain_remote_pages(struct zone *zone,
+				      struct per_cpu_pages *pcp)
+{
+}
+#endif /* CONFIG_SMP */
+
 static void free_one_page(struct zone *zone, struct page *page, int order,
 				int migratetype)
 {
@@ -746,11 +924,17 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
  * This array describes the order lists are fallen back to when
  * the free lists for the desirable migrate type are depleted
  */
-static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
-	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
-	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
+static int fallbacks[MIGRATE_TYPES][4] = {
+	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+#ifdef CONFIG_CMA
+	[MIGRATE_MOVABLE]     = { MIGRATE_CMA,         MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+	[MIGRATE_CMA]         = { MIGRATE_RESERVE }, /* Never used */
+#else
+	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE,   MIGRATE_RESERVE },
+#endif
+	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE }, /* Never used */
+	[MIGRATE_ISOLATE]     = { MIGRATE_RESERVE }, /* Never used */
 };
 
 /*
@@ -846,12 +1030,12 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 	/* Find the largest possible block of pages in the other list */
 	for (current_order = MAX_ORDER-1; current_order >= order;
 						--current_order) {
-		for (i = 0; i < MIGRATE_TYPES - 1; i++) {
+		for (i = 0;; i++) {
 			migratetype = fallbacks[start_migratetype][i];
 
 			/* MIGRATE_RESERVE handled later if necessary */
 			if (migratetype == MIGRATE_RESERVE)
-				continue;
+				break;
 
 			area = &(zone->free_area[current_order]);
 			if (list_empty(&area->free_list[migratetype]))
@@ -865,11 +1049,16 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * agressive about taking ownership of free pages
+			 * agressive about taking ownership of free pages.
+			 *
+			 * MIGRATE_CMA blocks are only ever borrowed: they
+			 * must keep their type so that the contiguous area
+			 * can be claimed back.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
+			if (!is_migrate_cma(migratetype) &&
+			    (unlikely(current_order >= (pageblock_order >> 1)) ||
 					start_migratetype == MIGRATE_RECLAIMABLE ||
-					page_group_by_mobility_disabled) {
+					page_group_by_mobility_disabled)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -888,7 +1077,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			rmv_page_order(page);
 
 			/* Take ownership for orders >= pageblock_order */
-			if (current_order >= pageblock_order)
+			if (current_order >= pageblock_order &&
+			    !is_migrate_cma(migratetype))
 				change_pageblock_range(page, current_order,
 							start_migratetype);
 
@@ -964,7 +1154,14 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+		/*
+		 * Pages borrowed from a MIGRATE_CMA block must go back to
+		 * the CMA free list when the pcp list is drained.
+		 */
+		if (is_migrate_cma(get_pageblock_migratetype(page)))
+			set_page_private(page, MIGRATE_CMA);
+		else
+			set_page_private(page, migratetype);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -1019,6 +1216,7 @@ static void drain_pages(unsigned int cpu)
 		local_irq_save(flags);
 		free_pcppages_bulk(zone, pcp->count, pcp);
 		pcp->count = 0;
+		drain_remote_pages(zone, pcp);
 		local_irq_restore(flags);
 	}
 }
@@ -1084,6 +1282,7 @@ static void free_hot_cold_page(struct page *page, int cold)
 	struct per_cpu_pages *pcp;
 	unsigned long flags;
 	int migratetype;
+	int cpu;
 	int wasMlocked = __TestClearPageMlocked(page);
 
 	kmemcheck_free_shadow(page, 0);
@@ -1100,7 +1299,8 @@ static void free_hot_cold_page(struct page *page, int cold)
 	arch_free_page(page, 0);
 	kernel_map_pages(page, 1, 0);
 
-	pcp = &zone_pcp(zone, get_cpu())->pcp;
+	cpu = get_cpu();
+	pcp = &zone_pcp(zone, cpu)->pcp;
 	migratetype = get_pageblock_migratetype(page);
 	set_page_private(page, migratetype);
 	local_irq_save(flags);
@@ -1123,6 +1323,9 @@ static void free_hot_cold_page(struct page *page, int cold)
 		migratetype = MIGRATE_MOVABLE;
 	}
 
+	if (free_remote_page(zone, pcp, page, cpu, cold))
+		goto out;
+
 	if (cold)
 		list_add_tail(&page->lru, &pcp->lists[migratetype]);
 	else
@@ -1172,6 +1375,55 @@ void split_page(struct page *page, unsigned int order)
 		set_page_refcounted(page + i);
 }
 
+/*
+ * Similar to split_page except the page is already free. As this is only
+ * being used for migration, the migratetype of the block also changes.
+ * As this is called with interrupts disabled, the caller is responsible
+ * for calling arch_alloc_page() and kernel_map_page() after interrupts
+ * are enabled.
+ *
+ * Note: this is probably too low level an operation for use in drivers.
+ * Please consult with lkml before using this in your driver.
+ */
+int split_free_page(struct page *page)
+{
+	unsigned int order;
+	unsigned long watermark;
+	struct zone *zone;
+
+	BUG_ON(!PageBuddy(page));
+
+	zone = page_zone(page);
+	order = page_order(page);
+
+	/* Obey watermarks as if the page was being allocated */
+	watermark = low_wmark_pages(zone) + (1 << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return 0;
+
+	/* Remove page from free list */
+	list_del(&page->lru);
+	zone->free_area[order].nr_free--;
+	rmv_page_order(page);
+	__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+	/* Split into individual pages */
+	set_page_refcounted(page);
+	split_page(page, order);
+
+	if (order >= pageblock_order - 1) {
+		struct page *endpage = page + (1 << order) - 1;
+		for (; page < endpage; page += pageblock_nr_pages) {
+			int mt = get_pageblock_migratetype(page);
+			if (mt != MIGRATE_ISOLATE && !is_migrate_cma(mt))
+				set_pageblock_migratetype(page,
+							  MIGRATE_MOVABLE);
+		}
+	}
+
+	return 1 << order;
+}
+
 /*
  * Really, prep_compound_page() should be called from __rmqueue_bulk().  But
  * we cheat by calling it from here, in the order > 0 path.  Saves a branch
@@ -1196,6 +1448,8 @@ again:
 		pcp = &zone_pcp(zone, cpu)->pcp;
 		list = &pcp->lists[migratetype];
 		local_irq_save(flags);
+		if (list_empty(list))
+			refill_remote_pages(zone, pcp);
 		if (list_empty(list)) {
 			pcp->count += rmqueue_bulk(zone, 0,
 					pcp->batch, list,
@@ -1211,6 +1465,7 @@ again:
 
 		list_del(&page->lru);
 		pcp->count--;
+		set_page_alloc_cpu(page, cpu);
 	} else {
 		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
 			/*
@@ -1672,6 +1927,62 @@ out:
 	return page;
 }
 
+#ifdef CONFIG_COMPACTION
+/* Try memory compaction for high-order allocations before reclaim */
+static struct page *
+__alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
+	struct zonelist *zonelist, enum zone_type high_zoneidx,
+	nodemask_t *nodemask, int alloc_flags, struct zone *preferred_zone,
+	int migratetype, unsigned long *did_some_progress)
+{
+	struct page *page;
+
+	if (!order || compaction_deferred(preferred_zone))
+		return NULL;
+
+	*did_some_progress = try_to_compact_pages(zonelist, order, gfp_mask,
+								nodemask);
+	if (*did_some_progress != COMPACT_SKIPPED) {
+
+		/* Page migration frees to the PCP lists but we want merging */
+		drain_pages(get_cpu());
+		put_cpu();
+
+		page = get_page_from_freelist(gfp_mask, nodemask,
+				order, zonelist, high_zoneidx,
+				alloc_flags, preferred_zone,
+				migratetype);
+		if (page) {
+			preferred_zone->compact_considered = 0;
+			preferred_zone->compact_defer_shift = 0;
+			count_vm_event(COMPACTSUCCESS);
+			return page;
+		}
+
+		/*
+		 * It's bad if compaction run occurs and fails.
+		 * The most likely reason is that pages exist,
+		 * but not enough to satisfy watermarks.
+		 */
+		count_vm_event(COMPACTFAIL);
+		defer_compaction(preferred_zone);
+
+		cond_resched();
+	}
+
+	return NULL;
+}
+#else
+static inline struct page *
+__alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
+	struct zonelist *zonelist, enum zone_type high_zoneidx,
+	nodemask_t *nodemask, int alloc_flags, struct zone *preferred_zone,
+	int migratetype, unsigned long *did_some_progress)
+{
+	return NULL;
+}
+#endif /* CONFIG_COMPACTION */
+
 /* The really slow allocator path where we enter direct reclaim */
 static inline struct page *
 __alloc_pages_direct_reclaim(gfp_t gfp_mask, unsigned int order,
@@ -1870,6 +2181,15 @@ rebalance:
 	if (test_thread_flag(TIF_MEMDIE) && !(gfp_mask & __GFP_NOFAIL))
 		goto nopage;
 
+	/* Try direct compaction */
+	page = __alloc_pages_direct_compact(gfp_mask, order,
+					zonelist, high_zoneidx,
+					nodemask,
+					alloc_flags, preferred_zone,
+					migratetype, &did_some_progress);
+	if (page)
+		goto got_pg;
+
 	/* Try direct reclaim and then allocating */
 	page = __alloc_pages_direct_reclaim(gfp_mask, order,
 					zonelist, high_zoneidx,
@@ -3080,6 +3400,11 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->batch = max(1UL, 1 * batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+#ifdef CONFIG_SMP
+	spin_lock_init(&pcp->remote_lock);
+	INIT_LIST_HEAD(&pcp->remote);
+	INIT_LIST_HEAD(&pcp->staged);
+#endif
 }
 
 /*
@@ -3272,6 +3597,7 @@ static int __zone_pcp_update(void *data)
 
 		local_irq_save(flags);
 		free_pcppages_bulk(zone, pcp->count, pcp);
+		drain_remote_pages(zone, pcp);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
 	}
@@ -5034,6 +5360,7 @@ int set_migratetype_isolate(struct page *page)
 	 * In future, more migrate types will be able to be isolation target.
 	 */
 	if (get_pageblock_migratetype(page) != MIGRATE_MOVABLE &&
+	    !is_migrate_cma(get_pageblock_migratetype(page)) &&
 	    zone_idx != ZONE_MOVABLE)
 		goto out;
 	set_pageblock_migratetype(page, MIGRATE_ISOLATE);
@@ -5046,7 +5373,7 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, unsigned migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
@@ -5054,8 +5381,8 @@ void unset_migratetype_isolate(struct page *page)
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	move_freepages_block(zone, page, migratetype);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
@@ -5106,3 +5433,231 @@ __offline_isolated_pages(unsigned long start_pfn, unsigned long end_pfn)
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 #endif
+
+#ifdef CONFIG_CMA
+/*
+ * Free a whole pageblock of boot-time reserved memory and set its
+ * migratetype to MIGRATE_CMA. The pages are then available to movable
+ * allocations until alloc_contig_range() claims them back.
+ */
+void __init init_cma_reserved_pageblock(struct page *page)
+{
+	unsigned i = pageblock_nr_pages;
+	struct page *p = page;
+
+	do {
+		__ClearPageReserved(p);
+		set_page_count(p, 0);
+	} while (++p, --i);
+
+	set_page_refcounted(page);
+	set_pageblock_migratetype(page, MIGRATE_CMA);
+	__free_pages(page, pageblock_order);
+	totalram_pages += pageblock_nr_pages;
+}
+
+static struct page *
+alloc_migrate_target(struct page *page, unsigned long private, int **x)
+{
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+/* Isolate up to COMPACT_CLUSTER_MAX LRU pages from [pfn, end) */
+static unsigned long isolate_lru_range(struct zone *zone, unsigned long pfn,
+				       unsigned long end, struct list_head *list)
+{
+	int nr = 0;
+
+	spin_lock_irq(&zone->lru_lock);
+	for (; pfn < end && nr < COMPACT_CLUSTER_MAX; pfn++) {
+		struct page *page = pfn_to_page(pfn);
+
+		if (PageBuddy(page))
+			continue;
+
+		if (__isolate_lru_page(page, ISOLATE_BOTH, 0) != 0)
+			continue;
+
+		del_page_from_lru_list(zone, page, page_lru(page));
+		list_add(&page->lru, list);
+		nr++;
+	}
+	spin_unlock_irq(&zone->lru_lock);
+
+	return pfn;
+}
+
+/* Migrate every movable page in [start, end) out of the range */
+static int __alloc_contig_migrate_range(struct zone *zone,
+					unsigned long start, unsigned long end)
+{
+	unsigned long pfn = start, chunk;
+	unsigned int tries = 0;
+	LIST_HEAD(list);
+	int ret;
+
+	migrate_prep();
+
+	while (pfn < end) {
+		if (fatal_signal_pending(current))
+			return -EINTR;
+
+		chunk = pfn;
+		pfn = isolate_lru_range(zone, chunk, end, &list);
+		if (list_empty(&list))
+			continue;
+
+		/* migrate_pages() puts back whatever it failed to move */
+		ret = migrate_pages(&list, alloc_migrate_target, 0);
+		if (ret < 0)
+			return ret;
+		if (ret > 0) {
+			if (++tries == 5)
+				return -EBUSY;
+			pfn = chunk;
+			continue;
+		}
+		tries = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Take the free pages of an isolated range off the buddy lists and
+ * hand them out as order-0 pages with a reference count of one. The
+ * buddy page holding the last pfn may reach past @end; it is split
+ * and claimed whole. Returns the pfn following the last page claimed,
+ * or zero if a page in the range was not free.
+ */
+static unsigned long __grab_isolated_range(struct zone *zone,
+					   unsigned long start,
+					   unsigned long end)
+{
+	unsigned long flags, pfn;
+	int ret = 0;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for (pfn = start; pfn < end; ) {
+		struct page *page = pfn_to_page(pfn);
+		unsigned int order;
+
+		if (!PageBuddy(page)) {
+			ret = -EBUSY;
+			break;
+		}
+
+		order = page_order(page);
+		list_del(&page->lru);
+		zone->free_area[order].nr_free--;
+		rmv_page_order(page);
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+		set_page_refcounted(page);
+		split_page(page, order);
+		pfn += 1 << order;
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	/* Give back whatever was grabbed before we hit a busy page */
+	if (ret) {
+		free_contig_range(start, pfn - start);
+		return 0;
+	}
+
+	kernel_map_pages(pfn_to_page(start), pfn - start, 1);
+	return pfn;
+}
+
+/**
+ * alloc_contig_range() -- tries to allocate given range of pages
+ * @start:	start PFN to allocate
+ * @end:	one-past-the-last PFN to allocate
+ *
+ * The PFN range does not have to be pageblock or MAX_ORDER_NR_PAGES
+ * aligned, however the enclosing MAX_ORDER_NR_PAGES/pageblock aligned
+ * range must consist of MIGRATE_CMA pageblocks from a single zone with
+ * no holes. Only [start, end) has to be free; pages elsewhere in the
+ * enclosing blocks may be in use, for instance by an earlier allocation.
+ *
+ * The movable pages in the range are migrated elsewhere, after which
+ * all pages in [start, end) belong to the caller and have a reference
+ * count of one. Returns zero on success or a negative error code.
+ * Must be called from process context; it may sleep.
+ */
+int alloc_contig_range(unsigned long start, unsigned long end)
+{
+	unsigned long align = max_t(unsigned long, MAX_ORDER_NR_PAGES,
+				    pageblock_nr_pages);
+	unsigned long iso_start = start & ~(align - 1);
+	unsigned long iso_end = ALIGN(end, align);
+	unsigned long outer_start, outer_end;
+	struct zone *zone = page_zone(pfn_to_page(start));
+	unsigned int order;
+	int ret;
+
+	/*
+	 * Isolating the blocks stops the allocator from handing out the
+	 * pages we are about to free up, and makes pages freed into the
+	 * range (including the ones migration releases) land on the
+	 * MIGRATE_ISOLATE free lists.
+	 */
+	ret = start_isolate_page_range(iso_start, iso_end, MIGRATE_CMA);
+	if (ret)
+		return ret;
+
+	ret = __alloc_contig_migrate_range(zone, start, end);
+	if (ret)
+		goto done;
+
+	/* Flush pages sitting in pagevecs and on the pcp lists */
+	lru_add_drain_all();
+	drain_all_pages();
+
+	/*
+	 * start may sit in the middle of a larger free buddy page. Look
+	 * for the head of the buddy that contains it, so that buddy can
+	 * be taken off the free list and split; the part before start is
+	 * freed again below.
+	 */
+	order = 0;
+	outer_start = start;
+	while (!PageBuddy(pfn_to_page(outer_start))) {
+		if (++order >= MAX_ORDER) {
+			outer_start = start;
+			break;
+		}
+		outer_start &= ~0UL << order;
+	}
+	if (outer_start != start &&
+	    outer_start + (1UL << page_order(pfn_to_page(outer_start))) <= start)
+		outer_start = start;
+
+	if (test_pages_isolated(outer_start, end)) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	outer_end = __grab_isolated_range(zone, outer_start, end);
+	if (!outer_end) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	/* Free the parts of the straddling buddies outside the range */
+	if (start != outer_start)
+		free_contig_range(outer_start, start - outer_start);
+	if (end != outer_end)
+		free_contig_range(end, outer_end - end);
+
+done:
+	undo_isolate_page_range(iso_start, iso_end, MIGRATE_CMA);
+	return ret;
+}
+
+void free_contig_range(unsigned long pfn, unsigned nr_pages)
+{
+	for (; nr_pages--; ++pfn)
+		__free_page(pfn_to_page(pfn));
+}
+#endif /* CONFIG_CMA */
@@ -17,6 +17,9 @@
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -290,6 +293,106 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
 	return min(newsize, max);
 }
 
+/*
+ * Adaptive readahead, enabled per device through the bdi sysfs attribute
+ * read_ahead_adaptive.
+ *
+ * The maximum window is no longer read_ahead_kb, but what the device
+ * delivers in RA_TARGET_USECS, or in eight times its average read latency
+ * if that is longer: enough to keep a fast device busy between two
+ * windows of a stream, while a slow one is not made to read for longer
+ * than that on behalf of a reader who may never get there.
+ *
+ * The initial window of a read with no known access pattern is scaled by
+ * how often such windows were read on into their readahead marker
+ * recently on this device.  When most are not, as on a device holding
+ * many small randomly accessed files, it shrinks towards the size of the
+ * read itself; a real stream is still detected and ramped up as usual.
+ */
+#define RA_TARGET_USECS		(100 * USEC_PER_MSEC)
+#define RA_MIN_PAGES		((16 * 1024) / PAGE_CACHE_SIZE)
+#define RA_MAX_PAGES		((2 * 1024 * 1024) / PAGE_CACHE_SIZE)
+
+/* initial windows of history to trust, and to keep */
+#define RA_HISTORY_MIN		16
+#define RA_HISTORY_MAX		256
+
+static unsigned long ra_max_pages(struct backing_dev_info *bdi,
+				  struct file_ra_state *ra)
+{
+	unsigned long kbps, usecs, pages;
+
+	if (!bdi->ra_adaptive)
+		return ra->ra_pages;
+
+	kbps = bdi_read_throughput(bdi);
+	if (!kbps)
+		return ra->ra_pages;
+
+	usecs = clamp_t(unsigned long, 8 * bdi_read_latency(bdi),
+			RA_TARGET_USECS, USEC_PER_SEC);
+	/* kbps * usecs overflows 32 bits from 4MB/s on */
+	pages = min_t(u64, div_u64((u64)kbps * usecs, USEC_PER_SEC),
+		      ULONG_MAX);
+	pages >>= PAGE_CACHE_SHIFT - 10;
+	pages = clamp_t(unsigned long, pages, RA_MIN_PAGES, RA_MAX_PAGES);
+
+	/* honour POSIX_FADV_SEQUENTIAL */
+	if (ra->ra_pages > bdi->ra_pages)
+		pages = max_t(unsigned long, pages, ra->ra_pages);
+
+	return pages;
+}
+
+static unsigned long ra_init_size(struct backing_dev_info *bdi,
+				  unsigned long req_size, unsigned long max)
+{
+	unsigned long size = get_init_ra_size(req_size, max);
+	unsigned long scaled;
+
+	if (!bdi->ra_adaptive || bdi->ra_initial < RA_HISTORY_MIN)
+		return size;
+
+	scaled = size * (bdi->ra_initial_hits + 1) / (bdi->ra_initial + 1);
+	/* keep one page beyond the read to carry the readahead marker */
+	return max(scaled, min(size, req_size + 1));
+}
+
+/*
+ * Record a new initial window, unless it reaches the end of the file: the
+ * reader cannot go past its marker then, whether it was useful or not.
+ */
+static void ra_note_initial(struct address_space *mapping,
+			    struct backing_dev_info *bdi,
+			    struct file_ra_state *ra)
+{
+	loff_t isize = i_size_read(mapping->host);
+	pgoff_t marker = ra->start + ra->size - ra->async_size;
+
+	ra->initial = 0;
+	if (!isize || marker > ((isize - 1) >> PAGE_CACHE_SHIFT))
+		return;
+
+	ra->initial = 1;
+	if (++bdi->ra_initial > RA_HISTORY_MAX) {
+		bdi->ra_initial /= 2;
+		bdi->ra_initial_hits /= 2;
+	}
+}
+
+/*
+ * The reader got to the marker of an initial window.
+ */
+static void ra_credit_initial(struct backing_dev_info *bdi,
+			      struct file_ra_state *ra)
+{
+	if (ra->initial) {
+		ra->initial = 0;
+		if (bdi->ra_initial_hits < bdi->ra_initial)
+			bdi->ra_initial_hits++;
+	}
+}
+
 /*
  * On-demand readahead design.
  *
@@ -391,7 +494,10 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned long max = max_sane_readahead(ra_max_pages(bdi, ra));
+	int pattern = RA_PATTERN_INITIAL;
+	unsigned long actual;
 
 	/*
 	 * start of file
@@ -405,6 +511,8 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
 	     offset == (ra->start + ra->size))) {
+		ra_credit_initial(bdi, ra);
+		pattern = RA_PATTERN_SUBSEQUENT;
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -432,14 +540,17 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_MARKER;
 		goto readit;
 	}
 
 	/*
 	 * oversize read
 	 */
-	if (req_size > max)
+	if (req_size > max) {
+		pattern = RA_PATTERN_OVERSIZE;
 		goto initial_readahead;
+	}
 
 	/*
 	 * sequential cache miss
@@ -451,18 +562,23 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	actual = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	trace_readahead(mapping, offset, req_size, hit_readahead_marker,
+			RA_PATTERN_RANDOM, offset, req_size, 0, actual);
+	return actual;
 
 initial_readahead:
 	ra->start = offset;
-	ra->size = get_init_ra_size(req_size, max);
+	ra->size = ra_init_size(bdi, req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
 
 readit:
@@ -476,7 +592,13 @@ readit:
 		ra->size += ra->async_size;
 	}
 
-	return ra_submit(ra, mapping, filp);
+	if (pattern == RA_PATTERN_INITIAL)
+		ra_note_initial(mapping, bdi, ra);
+
+	actual = ra_submit(ra, mapping, filp);
+	trace_readahead(mapping, offset, req_size, hit_readahead_marker,
+			pattern, ra->start, ra->size, ra->async_size, actual);
+	return actual;
 }
 
 /**
@@ -74,6 +74,14 @@
  * SLUB assigns one slab for allocation to each processor.
  * Allocations only occur from these slabs called cpu slabs.
  *
+ * Each processor may in addition keep a short list of frozen partial
+ * slabs, the cpu partial list. When the cpu slab is exhausted the next
+ * one is taken from there without touching the list_lock. The list is
+ * filled with slabs that see their first free after having been full
+ * and with extra slabs grabbed from the node partial list while its
+ * list_lock is held anyway. It is only ever manipulated by its own
+ * processor with interrupts disabled.
+ *
  * Slabs with free elements are kept on a partial list and during regular
  * operations no list for full slabs is used. If an object in a full slab is
  * freed then the slab will show up again on the partial lists.
@@ -102,6 +110,10 @@
  * 			free objects in addition to the regular freelist
  * 			that requires the slab lock.
  *
+ * 			The other use is for slabs on a cpu partial list.
+ * 			Their page->lru links them into that list instead
+ * 			of a node partial list.
+ *
  * PageError		Slab requires special handling due to debug
  * 			options set. This moves	slab handling out of
  * 			the fast path and disables lockless freelists.
@@ -1322,10 +1334,16 @@ static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
 
 /*
  * Try to allocate a partial slab from a specific node.
+ *
+ * While the list_lock is held, also move up to half of cpu_partial free
+ * objects worth of slabs onto the cpu partial list so that the next
+ * refills of the cpu slab do not have to come back here.
  */
-static struct page *get_partial_node(struct kmem_cache_node *n)
+static struct page *get_partial_node(struct kmem_cache *s,
+		struct kmem_cache_node *n, struct kmem_cache_cpu *c)
 {
-	struct page *page;
+	struct page *page, *page2;
+	struct page *first = NULL;
 
 	/*
 	 * Racy check. If we mistakenly see no partial slabs then we
@@ -1337,19 +1355,36 @@ static struct page *get_partial_node(struct kmem_cache_node *n)
 		return NULL;
 
 	spin_lock(&n->list_lock);
-	list_for_each_entry(page, &n->partial, lru)
-		if (lock_and_freeze_slab(n, page))
-			goto out;
-	page = NULL;
-out:
+	list_for_each_entry_safe(page, page2, &n->partial, lru) {
+		if (!first) {
+			if (lock_and_freeze_slab(n, page))
+				first = page;
+			continue;
+		}
+
+		if (!s->cpu_partial ||
+		    c->partial_objects > s->cpu_partial / 2)
+			break;
+		if (SLABDEBUG && PageSlubDebug(page))
+			continue;
+		if (!lock_and_freeze_slab(n, page))
+			continue;
+
+		c->partial_objects += page->objects - page->inuse;
+		slab_unlock(page);
+		list_add_tail(&page->lru, &c->partial);
+		c->nr_partial++;
+		stat(c, CPU_PARTIAL_NODE);
+	}
 	spin_unlock(&n->list_lock);
-	return page;
+	return first;
 }
 
 /*
  * Get a page from somewhere. Search in increasing NUMA distances.
  */
-static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
+static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags,
+				    struct kmem_cache_cpu *c)
 {
 #ifdef CONFIG_NUMA
 	struct zonelist *zonelist;
@@ -1388,7 +1423,7 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(n);
+			page = get_partial_node(s, n, c);
 			if (page)
 				return page;
 		}
@@ -1400,16 +1435,17 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 /*
  * Get a partial page, lock it and return it.
  */
-static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
+static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node,
+				struct kmem_cache_cpu *c)
 {
 	struct page *page;
 	int searchnode = (node == -1) ? numa_node_id() : node;
 
-	page = get_partial_node(get_node(s, searchnode));
+	page = get_partial_node(s, get_node(s, searchnode), c);
 	if (page || (flags & __GFP_THISNODE))
 		return page;
 
-	return get_any_partial(s, flags);
+	return get_any_partial(s, flags, c);
 }
 
 /*
@@ -1493,6 +1529,67 @@ static void deactivate_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	unfreeze_slab(s, page, tail);
 }
 
+/*
+ * Return all slabs on the cpu partial list to the node partial lists.
+ * Slabs that became empty meanwhile are freed if the node already has
+ * enough partial slabs.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct page *page, *page2;
+
+	list_for_each_entry_safe(page, page2, &c->partial, lru) {
+		list_del(&page->lru);
+		slab_lock(page);
+		unfreeze_slab(s, page, 1);
+	}
+	c->nr_partial = 0;
+	c->partial_objects = 0;
+}
+
+/*
+ * Put a frozen slab onto the cpu partial list. If the list already holds
+ * more than cpu_partial free objects then it is drained first.
+ *
+ * Interrupts must be disabled and the slab must not be locked.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct kmem_cache_cpu *c,
+			    struct page *page, int objects)
+{
+	if (c->partial_objects > s->cpu_partial) {
+		unfreeze_partials(s, c);
+		stat(c, CPU_PARTIAL_DRAIN);
+	}
+	list_add(&page->lru, &c->partial);
+	c->nr_partial++;
+	c->partial_objects += objects;
+}
+
+/*
+ * Take the first slab off the cpu partial list if it can satisfy an
+ * allocation for node. The slab is returned locked.
+ */
+static struct page *get_cpu_partial(struct kmem_cache_cpu *c, int node)
+{
+	struct page *page;
+
+	if (list_empty(&c->partial))
+		return NULL;
+
+	page = list_first_entry(&c->partial, struct page, lru);
+	if (node != -1 && page_to_nid(page) != node)
+		return NULL;
+
+	list_del(&page->lru);
+	slab_lock(page);
+	if (--c->nr_partial)
+		c->partial_objects = max(c->partial_objects -
+				(int)(page->objects - page->inuse), 0);
+	else
+		c->partial_objects = 0;
+	return page;
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(c, CPUSLAB_FLUSH);
@@ -1509,8 +1606,12 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = get_cpu_slab(s, cpu);
 
-	if (likely(c && c->page))
+	if (unlikely(!c))
+		return;
+
+	if (c->page)
 		flush_slab(s, c);
+	unfreeze_partials(s, c);
 }
 
 static void flush_cpu_slab(void *d)
@@ -1611,9 +1712,10 @@ slab_out_of_memory(struct kmem_cache *s, gfp_t gfpflags, int nid)
  * regular freelist. In that case we simply take over the regular freelist
  * as the lockless freelist and zap the regular freelist.
  *
- * If that is not working then we fall back to the partial lists. We take the
- * first element of the freelist as the object to allocate now and move the
- * rest of the freelist to the lockless freelist.
+ * If that is not working then we fall back to the cpu partial list and then
+ * to the node partial lists. We take the first element of the freelist as the
+ * object to allocate now and move the rest of the freelist to the lockless
+ * freelist.
  *
  * And if we were unable to get a new slab from the partial slab lists then
  * we need to allocate a new slab. This is the slowest path since it involves
@@ -1657,7 +1759,14 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
-	new = get_partial(s, gfpflags, node);
+	new = get_cpu_partial(c, node);
+	if (new) {
+		c->page = new;
+		stat(c, CPU_PARTIAL_ALLOC);
+		goto load_freelist;
+	}
+
+	new = get_partial(s, gfpflags, node, c);
 	if (new) {
 		c->page = new;
 		stat(c, ALLOC_FROM_PARTIAL);
@@ -1822,9 +1931,19 @@ checks_ok:
 
 	/*
 	 * Objects left in the slab. If it was not on the partial list before
-	 * then add it.
+	 * then add it, preferably to the cpu partial list of this processor
+	 * so that the node list_lock is not needed to put it back to use.
 	 */
 	if (unlikely(!prior)) {
+		if (s->cpu_partial && !(SLABDEBUG && PageSlubDebug(page))) {
+			int objects = page->objects - page->inuse;
+
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, c, page, objects);
+			stat(c, CPU_PARTIAL_FREE);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(c, FREE_ADD_PARTIAL);
 	}
@@ -2077,6 +2196,9 @@ static void init_kmem_cache_cpu(struct kmem_cache *s,
 	c->node = 0;
 	c->offset = s->offset / sizeof(void *);
 	c->objsize = s->objsize;
+	INIT_LIST_HEAD(&c->partial);
+	c->nr_partial = 0;
+	c->partial_objects = 0;
 #ifdef CONFIG_SLUB_STATS
 	memset(c->stat, 0, NR_SLUB_STAT_ITEMS * sizeof(unsigned));
 #endif
@@ -2493,6 +2615,26 @@ static int kmem_cache_open(struct kmem_cache *s, gfp_t gfpflags,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * cpu_partial is the number of free objects a processor may keep
+	 * in frozen slabs on its cpu partial list before they are handed
+	 * back to the node partial lists. When refilling from the node
+	 * lists only half of that is taken so that there is room left for
+	 * slabs that see frees. Slabs with debugging enabled are always
+	 * kept on the node lists.
+	 */
+	if (s->flags & (DEBUG_DEFAULT_FLAGS | SLAB_TRACE))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4088,6 +4230,31 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects > INT_MAX)
+		return -EINVAL;
+	if (objects && (s->flags & (DEBUG_DEFAULT_FLAGS | SLAB_TRACE)))
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (s->ctor) {
@@ -4123,6 +4290,37 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	int objects = 0;
+	int slabs = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu) {
+		struct kmem_cache_cpu *c = get_cpu_slab(s, cpu);
+
+		if (c) {
+			objects += c->partial_objects;
+			slabs += c->nr_partial;
+		}
+	}
+
+	len = sprintf(buf, "%d(%d)", objects, slabs);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		struct kmem_cache_cpu *c = get_cpu_slab(s, cpu);
+
+		if (c && c->nr_partial && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d(%d)", cpu,
+				       c->partial_objects, c->nr_partial);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4396,6 +4594,10 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4404,12 +4606,14 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&total_objects_attr.attr,
 	&slabs_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4450,6 +4654,10 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_node_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 	NULL
 };
@@ -0,0 +1,484 @@
+/*
+ * Compressed cache for clean page cache pages.
+ *
+ * On systems whose root filesystem lives on slow flash, re-reading a
+ * page that reclaim has just dropped means going back through the flash
+ * driver and usually a decompressor as well.  A compressed copy in RAM
+ * costs a fraction of the page and decompresses far faster than that.
+ *
+ * For filesystems that set FS_ZCACHE:
+ *
+ *  - when reclaim removes a clean, uptodate page from the page cache,
+ *    the page is LZO compressed and the result is kept, keyed by
+ *    (super block, inode number, page index);
+ *
+ *  - ->readpage asks the cache first; a hit is decompressed straight
+ *    into the new page cache page and the compressed copy is dropped,
+ *    so a page is never cached both ways at once;
+ *
+ *  - truncation, invalidation, deletion of the inode and unmount drop
+ *    the cached copies.  Eviction of the inode from the inode cache does
+ *    not, so that a file reopened later still finds its pages.
+ *
+ * The pool is bounded by vm.zcache_max_kbytes and kept in LRU order;
+ * it is also trimmed by a shrinker when memory gets tight.  Statistics
+ * are in /sys/kernel/mm/zcache/.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/radix-tree.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/sysctl.h>
+#include <linux/lzo.h>
+#include <linux/hash.h>
+#include <linux/zcache.h>
+
+/* pages that do not compress to at least this size are not worth it */
+#define ZCACHE_MAX_LENGTH	(PAGE_SIZE * 3 / 4)
+
+#define ZCACHE_HASH_BITS	8
+#define ZCACHE_HASH_SIZE	(1 << ZCACHE_HASH_BITS)
+
+#define ZCACHE_FLUSH_BATCH	16
+
+/* allocations are made from reclaim, with interrupts disabled */
+#define ZCACHE_GFP	(GFP_NOWAIT | __GFP_NORETRY | __GFP_NOWARN | \
+			 __GFP_NOMEMALLOC)
+
+/* the cached pages of one inode */
+struct zcache_inode {
+	struct hlist_node hash;
+	struct super_block *sb;
+	unsigned long ino;
+	struct radix_tree_root pages;
+	unsigned long nr_pages;
+};
+
+/* one compressed page */
+struct zcache_entry {
+	struct list_head lru;
+	struct zcache_inode *zi;
+	pgoff_t index;
+	unsigned int length;
+	unsigned char data[0];
+};
+
+unsigned long zcache_max_kbytes __read_mostly;
+
+static DEFINE_SPINLOCK(zcache_lock);
+static struct hlist_head zcache_hash[ZCACHE_HASH_SIZE];
+static LIST_HEAD(zcache_lru);
+static struct kmem_cache *zcache_inode_cache;
+static int zcache_initialized __read_mostly;
+
+static DEFINE_PER_CPU(void *, zcache_wrkmem);
+static DEFINE_PER_CPU(unsigned char *, zcache_dstmem);
+
+/* all protected by zcache_lock */
+static unsigned long zcache_stored_pages;
+static unsigned long zcache_compressed_bytes;
+static unsigned long zcache_total_bytes;
+static unsigned long zcache_hits;
+static unsigned long zcache_misses;
+static unsigned long zcache_puts;
+static unsigned long zcache_rejects;
+static unsigned long zcache_evictions;
+
+static inline struct hlist_head *zcache_hash_head(struct super_block *sb,
+						  unsigned long ino)
+{
+	unsigned long hash = (unsigned long)sb + ino;
+
+	return &zcache_hash[hash_long(hash, ZCACHE_HASH_BITS)];
+}
+
+static struct zcache_inode *zcache_lookup_inode(struct super_block *sb,
+						unsigned long ino)
+{
+	struct zcache_inode *zi;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(zi, node, zcache_hash_head(sb, ino), hash)
+		if (zi->sb == sb && zi->ino == ino)
+			return zi;
+	return NULL;
+}
+
+static struct zcache_inode *zcache_get_inode(struct super_block *sb,
+					     unsigned long ino)
+{
+	struct zcache_inode *zi;
+
+	zi = zcache_lookup_inode(sb, ino);
+	if (zi)
+		return zi;
+
+	zi = kmem_cache_alloc(zcache_inode_cache, ZCACHE_GFP);
+	if (!zi)
+		return NULL;
+	zi->sb = sb;
+	zi->ino = ino;
+	INIT_RADIX_TREE(&zi->pages, ZCACHE_GFP);
+	zi->nr_pages = 0;
+	hlist_add_head(&zi->hash, zcache_hash_head(sb, ino));
+	return zi;
+}
+
+static void zcache_put_inode(struct zcache_inode *zi)
+{
+	if (zi->nr_pages)
+		return;
+	hlist_del(&zi->hash);
+	kmem_cache_free(zcache_inode_cache, zi);
+}
+
+static inline unsigned long zcache_entry_size(struct zcache_entry *entry)
+{
+	return sizeof(*entry) + entry->length;
+}
+
+/*
+ * Unlink an entry from its inode and the LRU.  The caller frees it, and
+ * releases the inode if that was its last page.
+ */
+static void zcache_unlink_entry(struct zcache_entry *entry)
+{
+	struct zcache_inode *zi = entry->zi;
+
+	radix_tree_delete(&zi->pages, entry->index);
+	zi->nr_pages--;
+	list_del(&entry->lru);
+
+	zcache_stored_pages--;
+	zcache_compressed_bytes -= entry->length;
+	zcache_total_bytes -= zcache_entry_size(entry);
+}
+
+static void zcache_drop_entry(struct zcache_entry *entry)
+{
+	struct zcache_inode *zi = entry->zi;
+
+	zcache_unlink_entry(entry);
+	kfree(entry);
+	zcache_put_inode(zi);
+}
+
+/*
+ * Drop entries from the cold end of the LRU until the pool is no larger
+ * than @limit bytes.
+ */
+static void zcache_shrink_locked(unsigned long limit)
+{
+	struct zcache_entry *entry;
+
+	while (zcache_total_bytes > limit && !list_empty(&zcache_lru)) {
+		entry = list_entry(zcache_lru.prev, struct zcache_entry, lru);
+		zcache_drop_entry(entry);
+		zcache_evictions++;
+	}
+}
+
+static void zcache_shrink(unsigned long limit)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	zcache_shrink_locked(limit);
+	spin_unlock_irqrestore(&zcache_lock, flags);
+}
+
+static int zcache_compress(struct page *page, unsigned char **out,
+			   size_t *out_len)
+{
+	unsigned char *dst = __get_cpu_var(zcache_dstmem);
+	void *src;
+	int ret;
+
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, out_len,
+			       __get_cpu_var(zcache_wrkmem));
+	kunmap_atomic(src, KM_USER0);
+
+	*out = dst;
+	return ret == LZO_E_OK ? 0 : -EIO;
+}
+
+void __zcache_put_page(struct page *page)
+{
+	struct address_space *mapping = page->mapping;
+	struct inode *inode = mapping->host;
+	struct zcache_inode *zi;
+	struct zcache_entry *entry, *old;
+	unsigned char *data = NULL;
+	size_t length = 0;
+	unsigned long flags;
+
+	if (!zcache_initialized)
+		return;
+
+	/* the per cpu buffers are ours until the irqs come back on */
+	local_irq_save(flags);
+
+	entry = NULL;
+	if (PageUptodate(page) && !zcache_compress(page, &data, &length) &&
+	    length <= ZCACHE_MAX_LENGTH) {
+		entry = kmalloc(sizeof(*entry) + length, ZCACHE_GFP);
+		if (entry) {
+			entry->index = page->index;
+			entry->length = length;
+			memcpy(entry->data, data, length);
+		}
+	}
+
+	spin_lock(&zcache_lock);
+	if (entry)
+		zi = zcache_get_inode(inode->i_sb, inode->i_ino);
+	else
+		zi = zcache_lookup_inode(inode->i_sb, inode->i_ino);
+	if (!zi)
+		goto reject;
+
+	/* whatever was cached for this index before is stale now */
+	old = radix_tree_lookup(&zi->pages, page->index);
+	if (old) {
+		zcache_unlink_entry(old);
+		kfree(old);
+	}
+
+	if (!entry || radix_tree_insert(&zi->pages, page->index, entry)) {
+		zcache_put_inode(zi);
+		goto reject;
+	}
+
+	entry->zi = zi;
+	zi->nr_pages++;
+	list_add(&entry->lru, &zcache_lru);
+	zcache_stored_pages++;
+	zcache_compressed_bytes += entry->length;
+	zcache_total_bytes += zcache_entry_size(entry);
+	zcache_puts++;
+
+	zcache_shrink_locked(zcache_max_kbytes << 10);
+	spin_unlock_irqrestore(&zcache_lock, flags);
+	return;
+
+reject:
+	zcache_rejects++;
+	spin_unlock_irqrestore(&zcache_lock, flags);
+	kfree(entry);
+}
+
+int __zcache_get_page(struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	struct zcache_inode *zi;
+	struct zcache_entry *entry = NULL;
+	size_t length = PAGE_SIZE;
+	unsigned long flags;
+	void *dst;
+	int ret;
+
+	VM_BUG_ON(!PageLocked(page));
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	zi = zcache_lookup_inode(inode->i_sb, inode->i_ino);
+	if (zi)
+		entry = radix_tree_lookup(&zi->pages, page->index);
+	if (!entry) {
+		zcache_misses++;
+		spin_unlock_irqrestore(&zcache_lock, flags);
+		return -1;
+	}
+	zcache_unlink_entry(entry);
+	zcache_put_inode(zi);
+	zcache_hits++;
+	spin_unlock_irqrestore(&zcache_lock, flags);
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->length, dst, &length);
+	kunmap_atomic(dst, KM_USER0);
+	kfree(entry);
+
+	if (ret != LZO_E_OK || length != PAGE_SIZE) {
+		printk(KERN_ERR "zcache: corrupted page %lu of inode %lu\n",
+		       page->index, inode->i_ino);
+		return -1;
+	}
+
+	flush_dcache_page(page);
+	return 0;
+}
+EXPORT_SYMBOL(__zcache_get_page);
+
+static void zcache_flush_zi(struct zcache_inode *zi)
+{
+	struct zcache_entry *entries[ZCACHE_FLUSH_BATCH];
+	unsigned int i, nr;
+
+	while ((nr = radix_tree_gang_lookup(&zi->pages, (void **)entries,
+					    0, ZCACHE_FLUSH_BATCH))) {
+		for (i = 0; i < nr; i++) {
+			zcache_unlink_entry(entries[i]);
+			kfree(entries[i]);
+		}
+	}
+	zcache_put_inode(zi);
+}
+
+void __zcache_flush_inode(struct address_space *mapping)
+{
+	struct inode *inode = mapping->host;
+	struct zcache_inode *zi;
+	unsigned long flags;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	zi = zcache_lookup_inode(inode->i_sb, inode->i_ino);
+	if (zi)
+		zcache_flush_zi(zi);
+	spin_unlock_irqrestore(&zcache_lock, flags);
+}
+EXPORT_SYMBOL(__zcache_flush_inode);
+
+/*
+ * Called when a super block is shut down: nothing cached for it can be
+ * valid once the same address is reused for another mount.
+ */
+void zcache_flush_fs(struct super_block *sb)
+{
+	struct zcache_inode *zi;
+	struct hlist_node *node, *next;
+	unsigned long flags;
+	int i;
+
+	if (!zcache_initialized)
+		return;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	for (i = 0; i < ZCACHE_HASH_SIZE; i++)
+		hlist_for_each_entry_safe(zi, node, next, &zcache_hash[i], hash)
+			if (zi->sb == sb)
+				zcache_flush_zi(zi);
+	spin_unlock_irqrestore(&zcache_lock, flags);
+}
+
+int zcache_max_kbytes_handler(struct ctl_table *table, int write,
+			      void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
+	if (!ret && write)
+		zcache_shrink(zcache_max_kbytes << 10);
+	return ret;
+}
+
+static int zcache_shrinker_scan(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct zcache_entry *entry;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&zcache_lock, flags);
+	while (nr_to_scan-- > 0 && !list_empty(&zcache_lru)) {
+		entry = list_entry(zcache_lru.prev, struct zcache_entry, lru);
+		zcache_drop_entry(entry);
+		zcache_evictions++;
+	}
+	ret = min_t(unsigned long, zcache_stored_pages, INT_MAX);
+	spin_unlock_irqrestore(&zcache_lock, flags);
+
+	return ret;
+}
+
+static struct shrinker zcache_shrinker = {
+	.shrink = zcache_shrinker_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
+#ifdef CONFIG_SYSFS
+#define ZCACHE_ATTR_RO(_name) \
+	static ssize_t _name##_show(struct kobject *kobj, \
+				    struct kobj_attribute *attr, char *buf) \
+	{ \
+		return sprintf(buf, "%lu\n", zcache_##_name); \
+	} \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+
+ZCACHE_ATTR_RO(hits);
+ZCACHE_ATTR_RO(misses);
+ZCACHE_ATTR_RO(puts);
+ZCACHE_ATTR_RO(rejects);
+ZCACHE_ATTR_RO(evictions);
+ZCACHE_ATTR_RO(stored_pages);
+ZCACHE_ATTR_RO(compressed_bytes);
+ZCACHE_ATTR_RO(total_bytes);
+
+static struct attribute *zcache_attrs[] = {
+	&hits_attr.attr,
+	&misses_attr.attr,
+	&puts_attr.attr,
+	&rejects_attr.attr,
+	&evictions_attr.attr,
+	&stored_pages_attr.attr,
+	&compressed_bytes_attr.attr,
+	&total_bytes_attr.attr,
+	NULL,
+};
+
+static struct attribute_group zcache_attr_group = {
+	.attrs = zcache_attrs,
+	.name = "zcache",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init zcache_init(void)
+{
+	int cpu, i;
+
+	zcache_inode_cache = kmem_cache_create("zcache_inode",
+					       sizeof(struct zcache_inode),
+					       0, 0, NULL);
+	if (!zcache_inode_cache)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(zcache_wrkmem, cpu) = kmalloc(LZO1X_1_MEM_COMPRESS,
+						      GFP_KERNEL);
+		per_cpu(zcache_dstmem, cpu) =
+			kmalloc(lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL);
+		if (!per_cpu(zcache_wrkmem, cpu) ||
+		    !per_cpu(zcache_dstmem, cpu))
+			goto out_free;
+	}
+
+	for (i = 0; i < ZCACHE_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&zcache_hash[i]);
+
+	/* by default let the compressed pool grow to an eighth of memory */
+	zcache_max_kbytes = (totalram_pages / 8) << (PAGE_SHIFT - 10);
+	register_shrinker(&zcache_shrinker);
+	zcache_initialized = 1;
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &zcache_attr_group))
+		printk(KERN_ERR "zcache: register sysfs failed\n");
+#endif
+
+	return 0;
+
+out_free:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zcache_wrkmem, cpu));
+		kfree(per_cpu(zcache_dstmem, cpu));
+	}
+	kmem_cache_destroy(zcache_inode_cache);
+	return -ENOMEM;
+}
+module_init(zcache_init)
@@ -264,6 +264,7 @@
 #include <linux/cache.h>
 #include <linux/err.h>
 #include <linux/crypto.h>
+#include <linux/mm.h>
 
 #include <net/icmp.h>
 #include <net/tcp.h>
@@ -1273,6 +1274,172 @@ static inline struct sk_buff *tcp_recv_skb(struct sock *sk, u32 seq, u32 *off)
 	return NULL;
 }
 
+static int tcp_zc_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	/* Only pages mapped by TCP_ZEROCOPY_RECEIVE are valid */
+	return VM_FAULT_SIGBUS;
+}
+
+static const struct vm_operations_struct tcp_vm_ops = {
+	.fault		= tcp_zc_fault,
+};
+
+/*
+ * mmap() on a TCP socket only reserves a read-only window of user address
+ * space; the TCP_ZEROCOPY_RECEIVE socket option then maps received payload
+ * pages into it.
+ */
+int tcp_mmap(struct file *file, struct socket *sock,
+	     struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+		return -EPERM;
+	vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+	vma->vm_flags |= VM_DONTEXPAND;
+	vma->vm_ops = &tcp_vm_ops;
+	return 0;
+}
+EXPORT_SYMBOL(tcp_mmap);
+
+static u32 tcp_zc_inq(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct sk_buff *skb;
+	u32 inq;
+
+	if ((1 << sk->sk_state) & (TCPF_SYN_SENT | TCPF_SYN_RECV))
+		return 0;
+
+	inq = tp->rcv_nxt - tp->copied_seq;
+	/* Subtract 1, if FIN is in queue. */
+	skb = skb_peek_tail(&sk->sk_receive_queue);
+	if (inq && skb)
+		inq -= tcp_hdr(skb)->fin;
+
+	/* Never map past urgent data, it has to be read with recvmsg() */
+	if (tp->urg_data && !sock_flag(sk, SOCK_URGINLINE) &&
+	    !before(tp->urg_seq, tp->copied_seq) &&
+	    before(tp->urg_seq, tp->rcv_nxt))
+		inq = min(inq, tp->urg_seq - tp->copied_seq);
+	return inq;
+}
+
+/*
+ * Map as much of the receive queue as possible into the window set up by
+ * tcp_mmap().  Only payload held in full, page aligned page fragments can
+ * be mapped; everything else (linear data, partial pages, frag lists) is
+ * reported through recv_skip_hint and must be consumed with a normal
+ * recvmsg() copy before the next call.
+ */
+static int tcp_zerocopy_receive(struct sock *sk,
+				struct tcp_zerocopy_receive *zc)
+{
+	unsigned long address = (unsigned long)zc->address;
+	const skb_frag_t *frags = NULL;
+	u32 length = 0, seq, offset = 0;
+	struct vm_area_struct *vma;
+	struct sk_buff *skb = NULL;
+	struct tcp_sock *tp;
+	u32 inq;
+	int ret;
+
+	if (address & (PAGE_SIZE - 1) || address != zc->address)
+		return -EINVAL;
+
+	if (sk->sk_state == TCP_LISTEN)
+		return -ENOTCONN;
+
+	down_read(&current->mm->mmap_sem);
+
+	ret = -EINVAL;
+	vma = find_vma(current->mm, address);
+	if (!vma || vma->vm_start > address || vma->vm_ops != &tcp_vm_ops)
+		goto out;
+	zc->length = min_t(unsigned long, zc->length, vma->vm_end - address);
+
+	tp = tcp_sk(sk);
+	seq = tp->copied_seq;
+	inq = tcp_zc_inq(sk);
+	zc->length = min_t(u32, zc->length, inq);
+	zc->length &= ~(PAGE_SIZE - 1);
+	if (zc->length) {
+		zap_page_range(vma, address, zc->length, NULL);
+		zc->recv_skip_hint = 0;
+	} else {
+		zc->recv_skip_hint = inq;
+	}
+	ret = 0;
+	while (length + PAGE_SIZE <= zc->length) {
+		struct page *page;
+
+		if (zc->recv_skip_hint < PAGE_SIZE) {
+			if (skb) {
+				if (skb_queue_is_last(&sk->sk_receive_queue,
+						      skb))
+					break;
+				skb = skb->next;
+				offset = seq - TCP_SKB_CB(skb)->seq;
+			} else {
+				skb = tcp_recv_skb(sk, seq, &offset);
+			}
+			if (!skb)
+				break;
+
+			zc->recv_skip_hint = skb->len - offset;
+			offset -= skb_headlen(skb);
+			if ((int)offset < 0 || skb_has_frags(skb))
+				break;
+			frags = skb_shinfo(skb)->frags;
+			while (offset) {
+				if (frags->size > offset)
+					goto out;
+				offset -= frags->size;
+				frags++;
+			}
+		}
+		page = frags->page;
+		if (frags->size != PAGE_SIZE || frags->page_offset ||
+		    PageSlab(page) || PageHighMem(page))
+			break;
+		/* The payload was written through the kernel mapping */
+		flush_dcache_page(page);
+		ret = vm_insert_page(vma, address + length, page);
+		if (ret)
+			break;
+		length += PAGE_SIZE;
+		seq += PAGE_SIZE;
+		zc->recv_skip_hint -= PAGE_SIZE;
+		frags++;
+	}
+out:
+	up_read(&current->mm->mmap_sem);
+	if (length) {
+		tp->copied_seq = seq;
+		tcp_rcv_space_adjust(sk);
+
+		/* Release the skbs that have been completely mapped */
+		while ((skb = skb_peek(&sk->sk_receive_queue)) != NULL) {
+			offset = seq - TCP_SKB_CB(skb)->seq;
+			if (tcp_hdr(skb)->syn)
+				offset--;
+			if (offset < skb->len || tcp_hdr(skb)->fin)
+				break;
+			sk_eat_skb(sk, skb, 0);
+		}
+
+		/* Clean up data we have read: This will do ACK frames. */
+		tcp_cleanup_rbuf(sk, length);
+		ret = 0;
+		if (length == zc->length)
+			zc->recv_skip_hint = 0;
+	} else {
+		if (!zc->recv_skip_hint && sock_flag(sk, SOCK_DONE))
+			ret = -EIO;
+	}
+	zc->length = length;
+	return ret;
+}
+
 /*
  * This routine provides an alternative to tcp_recvmsg() for routines
  * that would like to handle copying from skbuffs directly in 'sendfile'
@@ -2426,6 +2593,23 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 		if (copy_to_user(optval, icsk->icsk_ca_ops->name, len))
 			return -EFAULT;
 		return 0;
+	case TCP_ZEROCOPY_RECEIVE: {
+		struct tcp_zerocopy_receive zc;
+		int err;
+
+		if (get_user(len, optlen))
+			return -EFAULT;
+		if (len != sizeof(zc))
+			return -EINVAL;
+		if (copy_from_user(&zc, optval, len))
+			return -EFAULT;
+		lock_sock(sk);
+		err = tcp_zerocopy_receive(sk, &zc);
+		release_sock(sk);
+		if (!err && copy_to_user(optval, &zc, len))
+			err = -EFAULT;
+		return err;
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -2972,6 +3156,8 @@ void __init tcp_init(void)
 	       tcp_hashinfo.ehash_size, tcp_hashinfo.bhash_size);
 
 	tcp_register_congestion_control(&tcp_reno);
+
+	tcp_tasklet_init();
 }
 
 EXPORT_SYMBOL(tcp_close);
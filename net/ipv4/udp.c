@@ -213,8 +213,18 @@ found:
 	inet_sk(sk)->num = snum;
 	sk->sk_hash = snum;
 	if (sk_unhashed(sk)) {
+		struct udp_sock *up = udp_sk(sk);
+		struct udp_hslot2 *hslot2;
+
 		sk_nulls_add_node_rcu(sk, &hslot->head);
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
+
+		up->udp_portaddr_hash = udp_portaddr_hashfn(net,
+						inet_sk(sk)->rcv_saddr, snum);
+		hslot2 = &udptable->hash2[up->udp_portaddr_hash];
+		spin_lock(&hslot2->lock);
+		hlist_add_head(&up->udp_portaddr_node, &hslot2->head);
+		spin_unlock(&hslot2->lock);
 	}
 	error = 0;
 fail_unlock:
@@ -342,33 +352,22 @@ struct sock *udp4_lib_lookup(struct net *net, __be32 saddr, __be16 sport,
 }
 EXPORT_SYMBOL_GPL(udp4_lib_lookup);
 
-static inline struct sock *udp_v4_mcast_next(struct net *net, struct sock *sk,
-					     __be16 loc_port, __be32 loc_addr,
-					     __be16 rmt_port, __be32 rmt_addr,
-					     int dif)
+static inline int udp_v4_mcast_match(struct net *net, struct sock *s,
+				     unsigned short hnum, __be32 loc_addr,
+				     __be16 rmt_port, __be32 rmt_addr,
+				     int dif)
 {
-	struct hlist_nulls_node *node;
-	struct sock *s = sk;
-	unsigned short hnum = ntohs(loc_port);
-
-	sk_nulls_for_each_from(s, node) {
-		struct inet_sock *inet = inet_sk(s);
-
-		if (!net_eq(sock_net(s), net)				||
-		    s->sk_hash != hnum					||
-		    (inet->daddr && inet->daddr != rmt_addr)		||
-		    (inet->dport != rmt_port && inet->dport)		||
-		    (inet->rcv_saddr && inet->rcv_saddr != loc_addr)	||
-		    ipv6_only_sock(s)					||
-		    (s->sk_bound_dev_if && s->sk_bound_dev_if != dif))
-			continue;
-		if (!ip_mc_sf_allow(s, loc_addr, rmt_addr, dif))
-			continue;
-		goto found;
-	}
-	s = NULL;
-found:
-	return s;
+	struct inet_sock *inet = inet_sk(s);
+
+	if (!net_eq(sock_net(s), net)				||
+	    s->sk_hash != hnum					||
+	    (inet->daddr && inet->daddr != rmt_addr)		||
+	    (inet->dport != rmt_port && inet->dport)		||
+	    (inet->rcv_saddr && inet->rcv_saddr != loc_addr)	||
+	    ipv6_only_sock(s)					||
+	    (s->sk_bound_dev_if && s->sk_bound_dev_if != dif))
+		return 0;
+	return ip_mc_sf_allow(s, loc_addr, rmt_addr, dif);
 }
 
 /*
@@ -1057,6 +1056,14 @@ void udp_lib_unhash(struct sock *sk)
 
 		spin_lock_bh(&hslot->lock);
 		if (sk_nulls_del_node_init_rcu(sk)) {
+			struct udp_sock *up = udp_sk(sk);
+			struct udp_hslot2 *hslot2;
+
+			hslot2 = &udptable->hash2[up->udp_portaddr_hash];
+			spin_lock(&hslot2->lock);
+			hlist_del_init(&up->udp_portaddr_node);
+			spin_unlock(&hslot2->lock);
+
 			inet_sk(sk)->num = 0;
 			sock_prot_inuse_add(sock_net(sk), sk->sk_prot, -1);
 		}
@@ -1072,11 +1079,10 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	if ((rc = sock_queue_rcv_skb(sk, skb)) < 0) {
 		/* Note that an ENOMEM error is charged twice */
-		if (rc == -ENOMEM) {
+		if (rc == -ENOMEM)
 			UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_RCVBUFERRORS,
 					 is_udplite);
-			atomic_inc(&sk->sk_drops);
-		}
+		atomic_inc(&sk->sk_drops);
 		goto drop;
 	}
 
@@ -1192,53 +1198,97 @@ int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 drop:
 	UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS, is_udplite);
+	atomic_inc(&sk->sk_drops);
 	kfree_skb(skb);
 	return -1;
 }
 
+static void flush_stack(struct sock **stack, unsigned int count,
+			struct sk_buff *skb, unsigned int final)
+{
+	unsigned int i;
+	struct sk_buff *skb1 = NULL;
+
+	for (i = 0; i < count; i++) {
+		struct sock *sk = stack[i];
+
+		if (likely(skb1 == NULL))
+			skb1 = (i == final) ? skb : skb_clone(skb, GFP_ATOMIC);
+
+		if (!skb1) {
+			atomic_inc(&sk->sk_drops);
+			UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_RCVBUFERRORS,
+					 IS_UDPLITE(sk));
+			UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS,
+					 IS_UDPLITE(sk));
+		}
+
+		/* An encapsulation socket may hand the skb back (ret > 0),
+		 * in which case it is reused for the next socket. */
+		if (skb1 && udp_queue_rcv_skb(sk, skb1) <= 0)
+			skb1 = NULL;
+		sock_put(sk);
+	}
+	if (unlikely(skb1))
+		kfree_skb(skb1);
+}
+
 /*
  *	Multicasts and broadcasts go to each listener.
  *
- *	Note: called only from the BH handler context,
- *	so we don't need to lock the hashes.
+ *	Only the (daddr, port) and (INADDR_ANY, port) slots of the secondary
+ *	hash can hold matching sockets: a socket is hashed on the address it
+ *	was bound to, and a non wildcard bind locks rcv_saddr for the life
+ *	of the socket (SOCK_BINDADDR_LOCK), so connect()/disconnect() can
+ *	only move rcv_saddr of sockets hashed on INADDR_ANY.
+ *
+ *	Matching sockets are collected under the slot lock and the datagram
+ *	is cloned and queued to them after the lock is dropped, one clone
+ *	per socket, the last one getting the original skb.
  */
 static int __udp4_lib_mcast_deliver(struct net *net, struct sk_buff *skb,
 				    struct udphdr  *uh,
 				    __be32 saddr, __be32 daddr,
 				    struct udp_table *udptable)
 {
-	struct sock *sk;
-	struct udp_hslot *hslot = &udptable->hash[udp_hashfn(net, ntohs(uh->dest))];
-	int dif;
-
-	spin_lock(&hslot->lock);
-	sk = sk_nulls_head(&hslot->head);
-	dif = skb->dev->ifindex;
-	sk = udp_v4_mcast_next(net, sk, uh->dest, daddr, uh->source, saddr, dif);
-	if (sk) {
-		struct sock *sknext = NULL;
-
-		do {
-			struct sk_buff *skb1 = skb;
-
-			sknext = udp_v4_mcast_next(net, sk_nulls_next(sk), uh->dest,
-						   daddr, uh->source, saddr,
-						   dif);
-			if (sknext)
-				skb1 = skb_clone(skb, GFP_ATOMIC);
-
-			if (skb1) {
-				int ret = udp_queue_rcv_skb(sk, skb1);
-				if (ret > 0)
-					/* we should probably re-process instead
-					 * of dropping packets here. */
-					kfree_skb(skb1);
-			}
-			sk = sknext;
-		} while (sknext);
-	} else
+	struct sock *sk, *stack[256 / sizeof(struct sock *)];
+	unsigned short hnum = ntohs(uh->dest);
+	struct udp_hslot2 *hslot2;
+	struct hlist_node *node;
+	struct udp_sock *up;
+	unsigned int hash, hash_any, count = 0;
+	int dif = skb->dev->ifindex;
+
+	hash = udp_portaddr_hashfn(net, daddr, hnum);
+	hash_any = udp_portaddr_hashfn(net, htonl(INADDR_ANY), hnum);
+start_lookup:
+	hslot2 = &udptable->hash2[hash];
+	spin_lock(&hslot2->lock);
+	hlist_for_each_entry(up, node, &hslot2->head, udp_portaddr_node) {
+		sk = (struct sock *)up;
+		if (!udp_v4_mcast_match(net, sk, hnum, daddr, uh->source,
+					saddr, dif))
+			continue;
+		stack[count++] = sk;
+		sock_hold(sk);
+		if (unlikely(count == ARRAY_SIZE(stack))) {
+			/* No final skb, every socket gets a clone */
+			flush_stack(stack, count, skb, ~0);
+			count = 0;
+		}
+	}
+	spin_unlock(&hslot2->lock);
+
+	/* Then the wildcard bound sockets, unless they share the slot */
+	if (hash != hash_any) {
+		hash = hash_any;
+		goto start_lookup;
+	}
+
+	if (count)
+		flush_stack(stack, count, skb, count - 1);
+	else
 		consume_skb(skb);
-	spin_unlock(&hslot->lock);
 	return 0;
 }
 
@@ -1832,6 +1882,8 @@ void __init udp_table_init(struct udp_table *table)
 	for (i = 0; i < UDP_HTABLE_SIZE; i++) {
 		INIT_HLIST_NULLS_HEAD(&table->hash[i].head, i);
 		spin_lock_init(&table->hash[i].lock);
+		INIT_HLIST_HEAD(&table->hash2[i].head);
+		spin_lock_init(&table->hash2[i].lock);
 	}
 }
 
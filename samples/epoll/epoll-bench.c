@@ -0,0 +1,181 @@
+/*
+ * epoll-bench: wakeups of one epoll set from many producer threads
+ *
+ * Usage: epoll-bench [-t max threads] [-s seconds]
+ *
+ * Each producer thread writes to its own eventfd in a loop; all the
+ * eventfds are in one epoll set, edge triggered, and one consumer thread
+ * waits on the set and drains whatever becomes ready.  1, 2, 4, ... up
+ * to <max threads> producers run for <seconds> each (default 2), and
+ * the number of writes and of epoll_wait() returns per second is
+ * printed.
+ *
+ * Every write runs the epoll callback of the set and queues the eventfd
+ * on its ready list.  When the callbacks serialize on a lock of the
+ * set, the total write rate stops growing with the number of producers;
+ * with the ready list insertion done under a shared lock it should keep
+ * growing until the CPUs run out.  E.g.:
+ *
+ *   $ epoll-bench -t 8
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+
+#define MAX_EVENTS	64
+
+static int epfd;
+static volatile int stop;
+
+struct producer {
+	pthread_t thread;
+	int fd;
+	unsigned long writes;
+};
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void *producer_fn(void *arg)
+{
+	struct producer *p = arg;
+	unsigned long writes = 0;
+	uint64_t one = 1;
+
+	/* count locally, the producers share cache lines */
+	while (!stop) {
+		if (write(p->fd, &one, sizeof(one)) != sizeof(one))
+			die("write");
+		writes++;
+	}
+	p->writes = writes;
+	return NULL;
+}
+
+static void *consumer_fn(void *arg)
+{
+	unsigned long *wakeups = arg;
+	struct epoll_event events[MAX_EVENTS];
+	uint64_t val;
+	int i, n;
+
+	while (!stop) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (n < 0)
+			die("epoll_wait");
+		for (i = 0; i < n; i++)
+			if (read(events[i].data.fd, &val, sizeof(val)) < 0)
+				die("read");
+		if (n)
+			(*wakeups)++;
+	}
+	return NULL;
+}
+
+static double run(struct producer *producers, int nr_threads, int seconds,
+		  double *wakeup_rate)
+{
+	struct timeval t0, t1;
+	unsigned long writes = 0, wakeups = 0;
+	pthread_t consumer;
+	double secs;
+	int i;
+
+	stop = 0;
+	gettimeofday(&t0, NULL);
+	if (pthread_create(&consumer, NULL, consumer_fn, &wakeups))
+		die("pthread_create");
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&producers[i].thread, NULL, producer_fn,
+				   &producers[i]))
+			die("pthread_create");
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(producers[i].thread, NULL);
+		writes += producers[i].writes;
+	}
+	pthread_join(consumer, NULL);
+	gettimeofday(&t1, NULL);
+
+	secs = t1.tv_sec - t0.tv_sec + (t1.tv_usec - t0.tv_usec) / 1e6;
+	*wakeup_rate = wakeups / secs;
+	return writes / secs;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = 0, seconds = 2, threads, i, c;
+	struct producer *producers;
+	struct epoll_event ev;
+	double single = 0, rate, wakeups;
+
+	while ((c = getopt(argc, argv, "t:s:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (argc != optind || seconds < 1)
+		goto usage;
+	if (max_threads < 1)
+		max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	epfd = epoll_create(1);
+	if (epfd < 0)
+		die("epoll_create");
+
+	producers = calloc(max_threads, sizeof(*producers));
+	if (!producers)
+		die("calloc");
+	for (i = 0; i < max_threads; i++) {
+		producers[i].fd = eventfd(0, EFD_NONBLOCK);
+		if (producers[i].fd < 0)
+			die("eventfd");
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = producers[i].fd;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, producers[i].fd, &ev))
+			die("epoll_ctl");
+	}
+
+	printf("eventfd writes into one epoll set, %ds per run\n", seconds);
+	for (threads = 1; ; threads *= 2) {
+		if (threads > max_threads)
+			threads = max_threads;
+		rate = run(producers, threads, seconds, &wakeups);
+		if (threads == 1)
+			single = rate;
+		printf("%3d producers: %12.0f writes/s, %5.2fx one producer, "
+		       "%10.0f wakeups/s\n", threads, rate, rate / single,
+		       wakeups);
+		if (threads == max_threads)
+			break;
+	}
+
+	for (i = 0; i < max_threads; i++)
+		close(producers[i].fd);
+	close(epfd);
+	free(producers);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: epoll-bench [-t max threads] [-s seconds]\n");
+	return 1;
+}
@@ -0,0 +1,163 @@
+/*
+ * fat-dir-bench: time creating and looking up files in one large directory
+ *
+ * Usage: fat-dir-bench [-n files] <directory>
+ *
+ * <directory> should be on a vfat mount, e.g. a loop mounted image:
+ *
+ *   $ dd if=/dev/zero of=fat.img bs=1M count=256
+ *   $ mkfs.vfat fat.img
+ *   # mount -o loop fat.img /mnt
+ *   # fat-dir-bench -n 10000 /mnt
+ *
+ * A subdirectory is created in <directory> and filled with long named
+ * files.  Then the dentry cache is dropped, so that every lookup has to
+ * search the directory, and all files are looked up in scattered order,
+ * followed by lookups of names that do not exist.  Finally the files
+ * are removed again.  Run as root so the caches can be dropped.
+ *
+ * vfat keeps a hashed name index of directories with 256 entries or
+ * more.  Without it, each lookup and each create parses the directory
+ * up to the name, so the time per file grows with the directory size;
+ * the time of the first and the last thousand creates is printed to
+ * show whether it does.  Compare with a kernel without the index, or
+ * with -n 200 for the cost of a linear scan of a small directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define BATCH	1000
+
+static char path[4096];
+static size_t dir_len;
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static const char *name(unsigned int i)
+{
+	sprintf(path + dir_len, "/Benchmark File %06u.data", i);
+	return path;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *what, unsigned int nr, double secs)
+{
+	printf("%-20s %6u in %8.3fs, %8.1f us each\n", what, nr, secs,
+	       secs * 1e6 / nr);
+}
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "2", 1) != 1)
+		fprintf(stderr, "cannot drop caches, lookups may be cached\n");
+	if (fd >= 0)
+		close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nr = 10000, i, j, step;
+	double start, batch;
+	struct stat st;
+	int c, fd;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		if (c != 'n')
+			goto usage;
+		nr = atoi(optarg);
+	}
+	if (argc - optind != 1 || !nr)
+		goto usage;
+
+	dir_len = snprintf(path, sizeof(path), "%s/fat-dir-bench",
+			   argv[optind]);
+	if (dir_len > sizeof(path) - 64) {
+		fprintf(stderr, "path too long\n");
+		return 1;
+	}
+	if (mkdir(path, 0755))
+		die(path);
+
+	start = batch = now();
+	for (i = 0; i < nr; i++) {
+		fd = open(name(i), O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0)
+			die(path);
+		close(fd);
+		if (i + 1 == BATCH && nr > 2 * BATCH)
+			report("create, first", BATCH, now() - batch);
+		if (i + 1 == nr - BATCH && nr > 2 * BATCH)
+			batch = now();
+	}
+	if (nr > 2 * BATCH)
+		report("create, last", BATCH, now() - batch);
+	report("create", nr, now() - start);
+
+	drop_caches();
+
+	/* Every file once, striding through the directory */
+	for (step = 7919; gcd(step, nr) != 1; step += 2)
+		;
+	start = now();
+	for (i = 0, j = 0; i < nr; i++, j = (j + step) % nr) {
+		if (stat(name(j), &st))
+			die(path);
+	}
+	report("lookup", nr, now() - start);
+
+	start = now();
+	for (i = 0; i < nr / 10 + 1; i++) {
+		if (!stat(name(nr + i), &st) || errno != ENOENT)
+			die(path);
+	}
+	report("negative lookup", nr / 10 + 1, now() - start);
+
+	start = now();
+	for (i = 0; i < nr; i++) {
+		if (unlink(name(i)))
+			die(path);
+	}
+	report("unlink", nr, now() - start);
+
+	path[dir_len] = '\0';
+	if (rmdir(path))
+		die(path);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: fat-dir-bench [-n files] <directory>\n");
+	return 1;
+}
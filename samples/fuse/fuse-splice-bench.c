@@ -0,0 +1,662 @@
+/*
+ * fuse-splice-bench: passthrough filesystem for comparing copying and
+ * splicing data over /dev/fuse
+ *
+ * Usage: fuse-splice-bench [-s] <backing dir> <mountpoint>
+ *
+ * The regular files of <backing dir> are made available at <mountpoint>.
+ * The daemon talks the FUSE protocol directly, without libfuse.  By
+ * default requests and replies are transferred with read() and write()
+ * on /dev/fuse.  With -s requests are spliced from /dev/fuse into a
+ * pipe, the data of WRITE requests is spliced from there to the backing
+ * file and READ replies are spliced from the backing file to /dev/fuse,
+ * so the file data never goes through the daemon's memory.
+ *
+ * The same maximum request size is used in both modes, small enough for
+ * a spliced request to fit into a pipe.  Throughput figures are printed
+ * when the filesystem is unmounted.  Must be run as root, e.g.:
+ *
+ *   # fuse-splice-bench -s /tmp/back /mnt &
+ *   # dd if=/dev/zero of=/mnt/file bs=1M count=1024 conv=fsync
+ *   # dd if=/mnt/file of=/dev/null bs=1M
+ *   # umount /mnt
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <linux/fuse.h>
+
+/* Pages in a default sized pipe, less the header and a misaligned page */
+#define MAX_IO_PAGES	12
+
+static int fuse_fd;
+static int dir_fd;
+static int use_splice;
+static int pipe_fd[2];
+static size_t max_io;
+static size_t bufsize;
+static char *buf;		/* requests */
+static char *outbuf;		/* reply data */
+
+static char **names;
+static unsigned int nr_names;
+
+static struct timeval start;
+static unsigned long long bytes_read, bytes_written;
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+/* Node IDs above the root are indices into the names table */
+static const char *node_name(__u64 nodeid)
+{
+	if (nodeid < FUSE_ROOT_ID + 1 || nodeid - FUSE_ROOT_ID > nr_names)
+		return NULL;
+	return names[nodeid - FUSE_ROOT_ID - 1];
+}
+
+static __u64 node_get(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_names; i++)
+		if (!strcmp(names[i], name))
+			return FUSE_ROOT_ID + 1 + i;
+
+	names = realloc(names, (nr_names + 1) * sizeof(*names));
+	if (!names)
+		die("realloc");
+	names[nr_names] = strdup(name);
+	if (!names[nr_names])
+		die("strdup");
+	return FUSE_ROOT_ID + 1 + nr_names++;
+}
+
+static int node_stat(__u64 nodeid, struct stat *st)
+{
+	const char *name;
+
+	if (nodeid == FUSE_ROOT_ID)
+		return fstat(dir_fd, st) ? -errno : 0;
+
+	name = node_name(nodeid);
+	if (!name)
+		return -ENOENT;
+	if (fstatat(dir_fd, name, st, AT_SYMLINK_NOFOLLOW))
+		return -errno;
+	return 0;
+}
+
+static void fill_attr(struct fuse_attr *attr, const struct stat *st,
+		      __u64 nodeid)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->atime = st->st_atim.tv_sec;
+	attr->mtime = st->st_mtim.tv_sec;
+	attr->ctime = st->st_ctim.tv_sec;
+	attr->atimensec = st->st_atim.tv_nsec;
+	attr->mtimensec = st->st_mtim.tv_nsec;
+	attr->ctimensec = st->st_ctim.tv_nsec;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->blksize = st->st_blksize;
+}
+
+static void send_reply(__u64 unique, int error, const void *arg,
+		       size_t argsize)
+{
+	struct fuse_out_header oh;
+	struct iovec iov[2];
+
+	if (error)
+		argsize = 0;
+
+	oh.len = sizeof(oh) + argsize;
+	oh.error = error;
+	oh.unique = unique;
+	iov[0].iov_base = &oh;
+	iov[0].iov_len = sizeof(oh);
+	iov[1].iov_base = (void *) arg;
+	iov[1].iov_len = argsize;
+
+	/* ENOENT means the request was interrupted in the meantime */
+	if (writev(fuse_fd, iov, argsize ? 2 : 1) < 0 && errno != ENOENT)
+		die("writing reply");
+}
+
+static void do_init(struct fuse_in_header *in, struct fuse_init_in *arg)
+{
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = FUSE_KERNEL_MINOR_VERSION;
+	out.max_readahead = arg->max_readahead;
+	if (out.max_readahead > max_io)
+		out.max_readahead = max_io;
+	out.flags = arg->flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES);
+	out.max_write = max_io;
+
+	if (arg->major != FUSE_KERNEL_VERSION) {
+		fprintf(stderr, "unsupported protocol version %u.%u\n",
+			arg->major, arg->minor);
+		exit(1);
+	}
+	send_reply(in->unique, 0, &out, sizeof(out));
+	gettimeofday(&start, NULL);
+}
+
+static void do_lookup(struct fuse_in_header *in, const char *name)
+{
+	struct fuse_entry_out out;
+	struct stat st;
+
+	if (in->nodeid != FUSE_ROOT_ID ||
+	    fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) ||
+	    !S_ISREG(st.st_mode)) {
+		send_reply(in->unique, -ENOENT, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.nodeid = node_get(name);
+	out.entry_valid = 1;
+	out.attr_valid = 1;
+	fill_attr(&out.attr, &st, out.nodeid);
+	send_reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void reply_attr(struct fuse_in_header *in)
+{
+	struct fuse_attr_out out;
+	struct stat st;
+	int err;
+
+	err = node_stat(in->nodeid, &st);
+	memset(&out, 0, sizeof(out));
+	out.attr_valid = 1;
+	fill_attr(&out.attr, &st, in->nodeid);
+	send_reply(in->unique, err, &out, sizeof(out));
+}
+
+static void do_setattr(struct fuse_in_header *in, struct fuse_setattr_in *arg)
+{
+	const char *name = node_name(in->nodeid);
+	int err = 0;
+
+	if (!name) {
+		send_reply(in->unique, -EACCES, NULL, 0);
+		return;
+	}
+
+	if (arg->valid & FATTR_SIZE) {
+		if (arg->valid & FATTR_FH) {
+			if (ftruncate(arg->fh, arg->size))
+				err = -errno;
+		} else {
+			int fd = openat(dir_fd, name, O_WRONLY);
+
+			if (fd < 0 || ftruncate(fd, arg->size))
+				err = -errno;
+			if (fd >= 0)
+				close(fd);
+		}
+	}
+	if (!err && (arg->valid & FATTR_MODE) &&
+	    fchmodat(dir_fd, name, arg->mode & 07777, 0))
+		err = -errno;
+	if (!err && (arg->valid & (FATTR_ATIME | FATTR_MTIME))) {
+		struct timespec ts[2];
+
+		ts[0].tv_sec = arg->atime;
+		ts[0].tv_nsec = arg->atimensec;
+		ts[1].tv_sec = arg->mtime;
+		ts[1].tv_nsec = arg->mtimensec;
+		if (!(arg->valid & FATTR_ATIME))
+			ts[0].tv_nsec = UTIME_OMIT;
+		else if (arg->valid & FATTR_ATIME_NOW)
+			ts[0].tv_nsec = UTIME_NOW;
+		if (!(arg->valid & FATTR_MTIME))
+			ts[1].tv_nsec = UTIME_OMIT;
+		else if (arg->valid & FATTR_MTIME_NOW)
+			ts[1].tv_nsec = UTIME_NOW;
+		if (utimensat(dir_fd, name, ts, AT_SYMLINK_NOFOLLOW))
+			err = -errno;
+	}
+
+	if (err)
+		send_reply(in->unique, err, NULL, 0);
+	else
+		reply_attr(in);
+}
+
+/* Offsets come with each request, appending is done by the kernel */
+#define OPEN_FLAGS_MASK	(~(O_APPEND | O_DIRECT | O_NOCTTY))
+
+static void do_open(struct fuse_in_header *in, struct fuse_open_in *arg)
+{
+	const char *name = node_name(in->nodeid);
+	struct fuse_open_out out;
+	int fd;
+
+	if (!name) {
+		send_reply(in->unique, -ENOENT, NULL, 0);
+		return;
+	}
+
+	fd = openat(dir_fd, name, arg->flags & OPEN_FLAGS_MASK);
+	if (fd < 0) {
+		send_reply(in->unique, -errno, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.fh = fd;
+	send_reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void do_create(struct fuse_in_header *in, struct fuse_create_in *arg)
+{
+	const char *name = (const char *) (arg + 1);
+	struct {
+		struct fuse_entry_out entry;
+		struct fuse_open_out open;
+	} out;
+	struct stat st;
+	int fd;
+
+	if (in->nodeid != FUSE_ROOT_ID) {
+		send_reply(in->unique, -ENOTDIR, NULL, 0);
+		return;
+	}
+
+	fd = openat(dir_fd, name, (arg->flags & OPEN_FLAGS_MASK) | O_CREAT,
+		    arg->mode & ~arg->umask);
+	if (fd < 0 || fstat(fd, &st)) {
+		send_reply(in->unique, -errno, NULL, 0);
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.entry.nodeid = node_get(name);
+	out.entry.entry_valid = 1;
+	out.entry.attr_valid = 1;
+	fill_attr(&out.entry.attr, &st, out.entry.nodeid);
+	out.open.fh = fd;
+	send_reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void do_read(struct fuse_in_header *in, struct fuse_read_in *arg)
+{
+	ssize_t res;
+
+	res = pread(arg->fh, outbuf, arg->size, arg->offset);
+	if (res < 0) {
+		send_reply(in->unique, -errno, NULL, 0);
+		return;
+	}
+	bytes_read += res;
+	send_reply(in->unique, 0, outbuf, res);
+}
+
+static void do_write(struct fuse_in_header *in, struct fuse_write_in *arg)
+{
+	struct fuse_write_out out;
+	ssize_t res;
+
+	res = pwrite(arg->fh, arg + 1, arg->size, arg->offset);
+	if (res < 0) {
+		send_reply(in->unique, -errno, NULL, 0);
+		return;
+	}
+	bytes_written += res;
+
+	memset(&out, 0, sizeof(out));
+	out.size = res;
+	send_reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void do_readdir(struct fuse_in_header *in, struct fuse_read_in *arg)
+{
+	size_t size = 0;
+	struct dirent *de;
+	__u64 off = 0;
+	DIR *dir;
+	int fd;
+
+	fd = openat(dir_fd, ".", O_RDONLY | O_DIRECTORY);
+	dir = fd < 0 ? NULL : fdopendir(fd);
+	if (!dir) {
+		send_reply(in->unique, -errno, NULL, 0);
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	while ((de = readdir(dir))) {
+		struct fuse_dirent *dirent = (void *) (outbuf + size);
+		size_t namelen = strlen(de->d_name);
+		size_t entsize = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + namelen);
+
+		if (de->d_type != DT_REG && strcmp(de->d_name, ".") &&
+		    strcmp(de->d_name, ".."))
+			continue;
+		if (off++ < arg->offset)
+			continue;
+		if (size + entsize > arg->size)
+			break;
+
+		memset(dirent, 0, entsize);
+		dirent->ino = de->d_ino;
+		dirent->off = off;
+		dirent->namelen = namelen;
+		dirent->type = de->d_type;
+		memcpy(dirent->name, de->d_name, namelen);
+		size += entsize;
+	}
+	closedir(dir);
+
+	send_reply(in->unique, 0, outbuf, size);
+}
+
+static void do_statfs(struct fuse_in_header *in)
+{
+	struct fuse_statfs_out out;
+	struct statvfs sv;
+
+	if (fstatvfs(dir_fd, &sv)) {
+		send_reply(in->unique, -errno, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.st.blocks = sv.f_blocks;
+	out.st.bfree = sv.f_bfree;
+	out.st.bavail = sv.f_bavail;
+	out.st.files = sv.f_files;
+	out.st.ffree = sv.f_ffree;
+	out.st.bsize = sv.f_bsize;
+	out.st.namelen = sv.f_namemax;
+	out.st.frsize = sv.f_frsize;
+	send_reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void process(struct fuse_in_header *in, void *arg)
+{
+	switch (in->opcode) {
+	case FUSE_INIT:
+		do_init(in, arg);
+		break;
+	case FUSE_LOOKUP:
+		do_lookup(in, arg);
+		break;
+	case FUSE_FORGET:
+		/* no reply */
+		break;
+	case FUSE_GETATTR:
+		reply_attr(in);
+		break;
+	case FUSE_SETATTR:
+		do_setattr(in, arg);
+		break;
+	case FUSE_OPEN:
+		do_open(in, arg);
+		break;
+	case FUSE_CREATE:
+		do_create(in, arg);
+		break;
+	case FUSE_READ:
+		do_read(in, arg);
+		break;
+	case FUSE_WRITE:
+		do_write(in, arg);
+		break;
+	case FUSE_RELEASE:
+		close(((struct fuse_release_in *) arg)->fh);
+		send_reply(in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FSYNC:
+		if (fsync(((struct fuse_fsync_in *) arg)->fh))
+			send_reply(in->unique, -errno, NULL, 0);
+		else
+			send_reply(in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FLUSH:
+	case FUSE_RELEASEDIR:
+		send_reply(in->unique, 0, NULL, 0);
+		break;
+	case FUSE_OPENDIR: {
+		struct fuse_open_out out;
+
+		memset(&out, 0, sizeof(out));
+		send_reply(in->unique, 0, &out, sizeof(out));
+		break;
+	}
+	case FUSE_READDIR:
+		do_readdir(in, arg);
+		break;
+	case FUSE_STATFS:
+		do_statfs(in);
+		break;
+	default:
+		send_reply(in->unique, -ENOSYS, NULL, 0);
+		break;
+	}
+}
+
+static void read_pipe(char *dst, size_t count)
+{
+	while (count) {
+		ssize_t res = read(pipe_fd[0], dst, count);
+
+		if (res <= 0)
+			die("reading pipe");
+		dst += res;
+		count -= res;
+	}
+}
+
+/* Throw away what is left of a message in the pipe */
+static void drain_pipe(size_t count)
+{
+	while (count) {
+		size_t len = count < bufsize ? count : bufsize;
+
+		read_pipe(outbuf, len);
+		count -= len;
+	}
+}
+
+static void splice_write(struct fuse_in_header *in, struct fuse_write_in *arg)
+{
+	struct fuse_write_out out;
+	loff_t off = arg->offset;
+	size_t left = arg->size;
+
+	while (left) {
+		ssize_t res = splice(pipe_fd[0], NULL, arg->fh, &off, left,
+				     SPLICE_F_MOVE);
+		if (res <= 0) {
+			int err = res ? -errno : -EIO;
+
+			drain_pipe(left);
+			send_reply(in->unique, err, NULL, 0);
+			return;
+		}
+		left -= res;
+	}
+	bytes_written += arg->size;
+
+	memset(&out, 0, sizeof(out));
+	out.size = arg->size;
+	send_reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void splice_read(struct fuse_in_header *in, struct fuse_read_in *arg)
+{
+	struct fuse_out_header oh;
+	loff_t off = arg->offset;
+	size_t size = 0;
+	size_t left;
+	struct stat st;
+
+	/* The length goes into the header, in front of the data */
+	if (fstat(arg->fh, &st)) {
+		send_reply(in->unique, -errno, NULL, 0);
+		return;
+	}
+	if (off < st.st_size)
+		size = st.st_size - off;
+	if (size > arg->size)
+		size = arg->size;
+
+	oh.len = sizeof(oh) + size;
+	oh.error = 0;
+	oh.unique = in->unique;
+	if (write(pipe_fd[1], &oh, sizeof(oh)) != sizeof(oh))
+		die("writing pipe");
+
+	for (left = size; left; ) {
+		ssize_t res = splice(arg->fh, &off, pipe_fd[1], NULL, left,
+				     SPLICE_F_MOVE);
+		if (res <= 0) {
+			/* the file was truncated under us */
+			drain_pipe(sizeof(oh) + size - left);
+			send_reply(in->unique, res ? -errno : -EIO, NULL, 0);
+			return;
+		}
+		left -= res;
+	}
+
+	if (splice(pipe_fd[0], NULL, fuse_fd, NULL, oh.len, 0) != oh.len) {
+		if (errno != ENOENT)
+			die("splicing reply");
+		drain_pipe(oh.len);
+		return;
+	}
+	bytes_read += size;
+}
+
+static int receive(void)
+{
+	struct fuse_in_header *in = (struct fuse_in_header *) buf;
+	ssize_t res;
+
+	if (!use_splice) {
+		res = read(fuse_fd, buf, bufsize);
+		if (res < 0)
+			return -errno;
+		process(in, in + 1);
+		return 0;
+	}
+
+	res = splice(fuse_fd, NULL, pipe_fd[1], NULL, bufsize, 0);
+	if (res < 0)
+		return -errno;
+
+	read_pipe(buf, sizeof(*in));
+	if (in->opcode == FUSE_WRITE) {
+		read_pipe(buf + sizeof(*in), sizeof(struct fuse_write_in));
+		splice_write(in, (struct fuse_write_in *) (in + 1));
+		return 0;
+	}
+
+	read_pipe(buf + sizeof(*in), res - sizeof(*in));
+	if (in->opcode == FUSE_READ)
+		splice_read(in, (struct fuse_read_in *) (in + 1));
+	else
+		process(in, in + 1);
+	return 0;
+}
+
+static void print_stats(void)
+{
+	struct timeval end;
+	double secs;
+
+	gettimeofday(&end, NULL);
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0;
+	if (secs <= 0)
+		secs = 1;
+
+	printf("%s: %.1f s, read %llu bytes (%.1f MB/s), "
+	       "written %llu bytes (%.1f MB/s)\n",
+	       use_splice ? "splice" : "copy", secs,
+	       bytes_read, bytes_read / secs / 1048576,
+	       bytes_written, bytes_written / secs / 1048576);
+}
+
+int main(int argc, char *argv[])
+{
+	char opts[256];
+	int err;
+
+	if (argc == 4 && !strcmp(argv[1], "-s")) {
+		use_splice = 1;
+		argv++;
+	} else if (argc != 3) {
+		fprintf(stderr, "usage: %s [-s] <backing dir> <mountpoint>\n",
+			argv[0]);
+		return 1;
+	}
+
+	max_io = MAX_IO_PAGES * getpagesize();
+	bufsize = max_io + getpagesize();
+	buf = malloc(bufsize);
+	outbuf = malloc(bufsize);
+	if (!buf || !outbuf)
+		die("malloc");
+
+	if (use_splice && pipe(pipe_fd))
+		die("pipe");
+
+	dir_fd = open(argv[1], O_RDONLY | O_DIRECTORY);
+	if (dir_fd < 0)
+		die(argv[1]);
+
+	fuse_fd = open("/dev/fuse", O_RDWR);
+	if (fuse_fd < 0)
+		die("/dev/fuse");
+
+	snprintf(opts, sizeof(opts), "fd=%i,rootmode=40000,user_id=%u,"
+		 "group_id=%u,default_permissions,allow_other,max_read=%zu",
+		 fuse_fd, getuid(), getgid(), max_io);
+	if (mount("fuse-splice-bench", argv[2], "fuse", MS_NOSUID | MS_NODEV,
+		  opts))
+		die("mount");
+
+	do {
+		err = receive();
+	} while (!err || err == -EINTR || err == -ENOENT || err == -EAGAIN);
+
+	if (err != -ENODEV) {
+		errno = -err;
+		die("receiving request");
+	}
+
+	print_stats();
+	return 0;
+}
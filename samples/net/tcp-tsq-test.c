@@ -0,0 +1,153 @@
+/*
+ * tcp-tsq-test: check that TCP Small Queues can be turned off
+ *
+ * Usage: tcp-tsq-test [-m megabytes]
+ *
+ * Sends the given amount of data (default 64MB) over a loopback TCP
+ * connection, once with net.ipv4.tcp_limit_output_bytes set to 0, which
+ * disables TSQ, and once with the value it had before.  A transfer that
+ * makes no progress for five seconds counts as stalled.  The sysctl is
+ * restored at the end.  Must be run as root.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SYSCTL	"/proc/sys/net/ipv4/tcp_limit_output_bytes"
+#define TIMEOUT	5
+
+static char buf[65536];
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static long read_sysctl(void)
+{
+	long val;
+	FILE *f = fopen(SYSCTL, "r");
+
+	if (!f || fscanf(f, "%ld", &val) != 1)
+		die(SYSCTL);
+	fclose(f);
+	return val;
+}
+
+static void write_sysctl(long val)
+{
+	FILE *f = fopen(SYSCTL, "w");
+
+	if (!f || fprintf(f, "%ld\n", val) < 0 || fclose(f))
+		die(SYSCTL);
+}
+
+static void receiver(int lfd)
+{
+	int fd = accept(lfd, NULL, NULL);
+
+	if (fd < 0)
+		die("accept");
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	exit(0);
+}
+
+/* Returns 0 if all data was sent */
+static int transfer(long limit, unsigned long long bytes)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	struct timeval tv = { TIMEOUT, 0 }, t0, t1;
+	unsigned long long sent = 0;
+	int lfd, fd, status;
+	double secs;
+	pid_t pid;
+
+	write_sysctl(limit);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 1) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len))
+		die("listen");
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid)
+		receiver(lfd);
+	close(lfd);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		die("connect");
+	/* a stalled socket makes write() time out */
+	if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)))
+		die("SO_SNDTIMEO");
+
+	gettimeofday(&t0, NULL);
+	while (sent < bytes) {
+		ssize_t n = write(fd, buf, sizeof(buf));
+
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				die("write");
+			break;
+		}
+		sent += n;
+	}
+	gettimeofday(&t1, NULL);
+	close(fd);
+
+	if (sent < bytes) {
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		printf("tcp_limit_output_bytes=%ld: FAIL, stalled after %llu "
+		       "bytes\n", limit, sent);
+		return 1;
+	}
+	waitpid(pid, &status, 0);
+
+	secs = t1.tv_sec - t0.tv_sec + (t1.tv_usec - t0.tv_usec) / 1e6;
+	printf("tcp_limit_output_bytes=%ld: ok, %.1f MB/s\n", limit,
+	       sent / secs / (1024 * 1024));
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long bytes = 64ULL << 20;
+	long saved;
+	int c, ret;
+
+	while ((c = getopt(argc, argv, "m:")) != -1) {
+		if (c != 'm') {
+			fprintf(stderr, "usage: tcp-tsq-test [-m megabytes]\n");
+			return 1;
+		}
+		bytes = strtoull(optarg, NULL, 0) << 20;
+	}
+
+	saved = read_sysctl();
+	ret = transfer(0, bytes);
+	if (saved)
+		ret |= transfer(saved, bytes);
+	write_sysctl(saved);
+
+	return ret;
+}
@@ -0,0 +1,246 @@
+/*
+ * squashfs-bench: read throughput and CPU cost of a squashfs image
+ *
+ * Usage: squashfs-bench [-n runs] [-o options] [-f] <image> <mountpoint>
+ *
+ * The image is attached to a free loop device and mounted read-only at
+ * <mountpoint>, with the given mount options (metadata_cache=,
+ * fragment_cache=, data_cache=).  Each run drops the page cache and
+ * then reads every regular file below <mountpoint>: whole files by
+ * default, only their first 4kB with -f, which approximates many small
+ * random reads.  Squashfs decompresses in the context of the reader, so
+ * the system time of the runs is mostly decompression.  The cache
+ * statistics of the mount are printed after the last run.
+ *
+ * Build the same tree with the compressors to compare and run on each
+ * image, e.g.:
+ *
+ *   $ mksquashfs /usr usr-gzip.sqfs -comp gzip
+ *   $ mksquashfs /usr usr-lzo.sqfs -comp lzo
+ *   # squashfs-bench -n 3 usr-gzip.sqfs /mnt
+ *   # squashfs-bench -n 3 usr-lzo.sqfs /mnt
+ *
+ * Must be run as root.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <linux/loop.h>
+
+#define SQUASHFS_MAGIC	0x73717368
+#define MAX_LOOP	8
+#define BUF_SIZE	(128 * 1024)
+
+static const char *compressors[] = {
+	[1] = "gzip", [2] = "lzma", [3] = "lzo", [4] = "xz",
+};
+
+static int first_page_only;
+static char buf[BUF_SIZE];
+static unsigned long long bytes_read;
+static unsigned long files_read;
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static unsigned int get_le(const unsigned char *p, int len)
+{
+	unsigned int v = 0;
+
+	while (len--)
+		v = v << 8 | p[len];
+	return v;
+}
+
+/* Print what the superblock says about the image */
+static void show_image(int fd, const char *image)
+{
+	unsigned char sb[96];
+	unsigned int comp;
+
+	if (pread(fd, sb, sizeof(sb), 0) != sizeof(sb))
+		die("read superblock");
+	if (get_le(sb, 4) != SQUASHFS_MAGIC) {
+		fprintf(stderr, "%s: not a squashfs image\n", image);
+		exit(1);
+	}
+
+	comp = get_le(sb + 20, 2);
+	printf("%s: %s, %u byte blocks, %u inodes\n", image,
+	       comp < 5 && compressors[comp] ? compressors[comp] : "unknown",
+	       get_le(sb + 12, 4), get_le(sb + 4, 4));
+}
+
+/* Bind the image to the first unused loop device */
+static int loop_attach(int image_fd, char *dev)
+{
+	int i, fd;
+
+	for (i = 0; i < MAX_LOOP; i++) {
+		sprintf(dev, "/dev/loop%d", i);
+		fd = open(dev, O_RDONLY);
+		if (fd < 0)
+			continue;
+		if (ioctl(fd, LOOP_SET_FD, image_fd) == 0)
+			return fd;
+		close(fd);
+	}
+	fprintf(stderr, "no free loop device\n");
+	exit(1);
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		die("drop_caches");
+	close(fd);
+}
+
+static int read_file(const char *path, const struct stat *st, int type,
+		     struct FTW *ftw)
+{
+	ssize_t n;
+	int fd;
+
+	if (type != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die(path);
+	do {
+		n = read(fd, buf, first_page_only ? 4096 : BUF_SIZE);
+		if (n < 0)
+			die(path);
+		bytes_read += n;
+	} while (n > 0 && !first_page_only);
+	close(fd);
+	files_read++;
+	return 0;
+}
+
+static double tv_secs(struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void show_cache_stats(const char *dev)
+{
+	static const char *caches[] = { "metadata", "fragment", "data" };
+	static const char *fields[] = { "entries", "hits", "misses" };
+	char path[128];
+	unsigned int i, j;
+
+	for (i = 0; i < 3; i++) {
+		printf("%-9s cache:", caches[i]);
+		for (j = 0; j < 3; j++) {
+			unsigned long val = 0;
+			FILE *f;
+
+			sprintf(path, "/sys/fs/squashfs/%s/%s_cache_%s",
+				strrchr(dev, '/') + 1, caches[i], fields[j]);
+			f = fopen(path, "r");
+			if (f) {
+				if (fscanf(f, "%lu", &val) != 1)
+					val = 0;
+				fclose(f);
+			}
+			printf(" %s %lu", fields[j], val);
+		}
+		printf("\n");
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: squashfs-bench [-n runs] [-o options] [-f] "
+		"<image> <mountpoint>\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *image, *mnt, *options = NULL;
+	int runs = 1, image_fd, loop_fd, i, c;
+	char dev[32];
+
+	while ((c = getopt(argc, argv, "n:o:f")) != -1) {
+		switch (c) {
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		case 'o':
+			options = optarg;
+			break;
+		case 'f':
+			first_page_only = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2 || runs < 1)
+		usage();
+	image = argv[optind];
+	mnt = argv[optind + 1];
+
+	image_fd = open(image, O_RDONLY);
+	if (image_fd < 0)
+		die(image);
+	show_image(image_fd, image);
+
+	loop_fd = loop_attach(image_fd, dev);
+	if (mount(dev, mnt, "squashfs", MS_RDONLY, options)) {
+		perror("mount");
+		ioctl(loop_fd, LOOP_CLR_FD, 0);
+		return 1;
+	}
+
+	for (i = 0; i < runs; i++) {
+		struct rusage ru0, ru1;
+		struct timeval t0, t1;
+		double secs, sys;
+
+		drop_caches();
+		bytes_read = 0;
+		files_read = 0;
+
+		getrusage(RUSAGE_SELF, &ru0);
+		gettimeofday(&t0, NULL);
+		if (nftw(mnt, read_file, 32, FTW_PHYS | FTW_MOUNT))
+			die("nftw");
+		gettimeofday(&t1, NULL);
+		getrusage(RUSAGE_SELF, &ru1);
+
+		secs = tv_secs(&t1) - tv_secs(&t0);
+		sys = tv_secs(&ru1.ru_stime) - tv_secs(&ru0.ru_stime);
+		printf("run %d: %lu files, %llu kB in %.3fs, %.1f MB/s, "
+		       "%.3fs system\n", i + 1, files_read, bytes_read / 1024,
+		       secs, bytes_read / secs / (1024 * 1024), sys);
+	}
+
+	show_cache_stats(dev);
+
+	if (umount(mnt))
+		die("umount");
+	if (ioctl(loop_fd, LOOP_CLR_FD, 0))
+		die("LOOP_CLR_FD");
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * stat-bench: stat() throughput of a deep path from parallel threads
+ *
+ * Usage: stat-bench [-d depth] [-t max threads] [-s seconds] <directory>
+ *
+ * A chain of <depth> nested directories with a file at the bottom is
+ * created in <directory>.  Then 1, 2, 4, ... up to <max threads>
+ * threads stat() that file, all through the same path, for <seconds>
+ * each, and the number of calls per second is printed.
+ *
+ * Every call looks up the same intermediate dentries.  When the walk
+ * takes a reference and the d_lock of each of them, the threads bounce
+ * those cache lines between CPUs and the total rate stops growing with
+ * the thread count; with the RCU path walk it should scale until the
+ * CPUs run out.  The filesystem matters: the RCU walk is only used on
+ * filesystems which free their inodes after a grace period (tmpfs,
+ * ext2/3/4 and proc in this tree).  E.g.:
+ *
+ *   $ stat-bench -t 8 /dev/shm
+ *   $ stat-bench -t 8 -d 16 /tmp
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static char path[4096];
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned long calls;
+};
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long calls = 0;
+	struct stat st;
+
+	/* count locally, the workers share cache lines */
+	while (!stop) {
+		if (stat(path, &st))
+			die(path);
+		calls++;
+	}
+	w->calls = calls;
+	return NULL;
+}
+
+static double run(int nr_threads, int seconds)
+{
+	struct worker *workers;
+	struct timeval t0, t1;
+	unsigned long calls = 0;
+	int i;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+
+	stop = 0;
+	gettimeofday(&t0, NULL);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			die("pthread_create");
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		calls += workers[i].calls;
+	}
+	gettimeofday(&t1, NULL);
+
+	free(workers);
+	return calls / (t1.tv_sec - t0.tv_sec +
+			(t1.tv_usec - t0.tv_usec) / 1e6);
+}
+
+/* Remove what was created, bottom up */
+static void cleanup(int depth)
+{
+	if (unlink(path))
+		die(path);
+	while (depth--) {
+		*strrchr(path, '/') = '\0';
+		if (rmdir(path))
+			die(path);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int depth = 8, max_threads = 0, seconds = 2, threads, i, c, fd;
+	double single = 0, rate;
+
+	while ((c = getopt(argc, argv, "d:t:s:")) != -1) {
+		switch (c) {
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (argc - optind != 1 || depth < 1 || depth > 64 || seconds < 1)
+		goto usage;
+	if (max_threads < 1)
+		max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (strlen(argv[optind]) > sizeof(path) - 64 * 16 - 8) {
+		fprintf(stderr, "path too long\n");
+		return 1;
+	}
+	strcpy(path, argv[optind]);
+	for (i = 0; i < depth; i++) {
+		sprintf(path + strlen(path), "/stat-bench.%d", i);
+		if (mkdir(path, 0755))
+			die(path);
+	}
+	strcat(path, "/file");
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		die(path);
+	close(fd);
+
+	printf("stat() of a file %d directories deep, %ds per run\n",
+	       depth, seconds);
+	for (threads = 1; ; threads *= 2) {
+		if (threads > max_threads)
+			threads = max_threads;
+		rate = run(threads, seconds);
+		if (threads == 1)
+			single = rate;
+		printf("%3d threads: %12.0f calls/s, %5.2fx one thread\n",
+		       threads, rate, rate / single);
+		if (threads == max_threads)
+			break;
+	}
+
+	cleanup(depth);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: stat-bench [-d depth] [-t max threads] "
+		"[-s seconds] <directory>\n");
+	return 1;
+}
@@ -519,6 +519,19 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * MAY_EXEC check for the lockless path walk, which holds no reference
+ * on @inode.  Security modules are not prepared for that, so only the
+ * default operations (which allow everything) are done here and any
+ * registered module makes the walk fall back to the ordinary one.
+ */
+int security_inode_exec_permission_rcu(struct inode *inode)
+{
+	if (security_ops != &default_security_ops)
+		return -ECHILD;
+	return 0;
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))
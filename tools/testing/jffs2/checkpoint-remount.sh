@@ -0,0 +1,152 @@
+#!/bin/sh
+#
+# Mount/unmount/remount check of JFFS2 checkpoints (CONFIG_JFFS2_CHECKPOINT)
+# on a simulated flash.
+#
+# Usage: checkpoint-remount.sh [nand|nor] [mountpoint]
+#
+# nand uses nandsim (16MiB, 512 byte pages), nor uses mtdram (16MiB,
+# 128KiB eraseblocks).  The script
+#
+#  1. fills an empty filesystem with files and records their checksums,
+#  2. unmounts and remounts it, and checks that the checkpoint written
+#     at unmount was used and that all files read back unchanged,
+#  3. changes files, remounts again and checks the same,
+#  4. (nor only) changes files, copies the flash while still mounted,
+#     which is what a power cut would leave, and mounts that copy: the
+#     checkpoint must have been invalidated by the first change, so the
+#     whole medium has to be scanned and the synced contents found.
+#
+# Mount times are printed for comparison with a kernel built without
+# checkpoints.  Must be run as root on a kernel with JFFS2 and the
+# nandsim and mtdram drivers available as modules.
+
+TYPE=${1:-nand}
+MNT=${2:-/mnt/jffs2-ckpt}
+TMP=$(mktemp -d /tmp/jffs2-ckpt.XXXXXX)
+FAILED=0
+
+fail()
+{
+	echo "FAIL: $*"
+	FAILED=1
+}
+
+load_flash()
+{
+	case $TYPE in
+	nand)
+		modprobe nandsim first_id_byte=0x20 second_id_byte=0x73 || exit 1
+		NAME="NAND simulator"
+		;;
+	nor)
+		modprobe mtdram total_size=16384 erase_size=128 || exit 1
+		NAME="mtdram test device"
+		;;
+	*)
+		echo "usage: $0 [nand|nor] [mountpoint]"
+		exit 1
+		;;
+	esac
+	MTD=$(grep "\"$NAME" /proc/mtd | sed -n 's/^mtd\([0-9]*\):.*/\1/p' | head -n 1)
+	if [ -z "$MTD" ]; then
+		echo "cannot find the \"$NAME\" mtd device"
+		exit 1
+	fi
+}
+
+unload_flash()
+{
+	case $TYPE in
+	nand)	rmmod nandsim ;;
+	nor)	rmmod mtdram ;;
+	esac
+}
+
+# mount_fs <expect "checkpoint" or "scan">
+mount_fs()
+{
+	dmesg -c > /dev/null
+	START=$(date +%s.%N)
+	mount -t jffs2 mtd$MTD $MNT || { fail "mount"; return; }
+	END=$(date +%s.%N)
+	echo "mount took $(awk "BEGIN { print $END - $START }")s"
+
+	if dmesg | grep -q "using checkpoint"; then
+		USED=checkpoint
+	else
+		USED=scan
+	fi
+	[ $USED = $1 ] || fail "expected mount from $1, got $USED"
+}
+
+fill()
+{
+	for d in $(seq 1 $1); do
+		mkdir -p $MNT/dir$d
+		for f in $(seq 1 50); do
+			dd if=/dev/urandom of=$MNT/dir$d/file$f \
+			   bs=$((f * 97)) count=1 2> /dev/null
+		done
+	done
+	sync
+}
+
+check()
+{
+	(cd $MNT && find . -type f | sort | xargs md5sum) > $TMP/now
+	cmp -s $TMP/sums $TMP/now || fail "$1: file contents differ"
+}
+
+record()
+{
+	(cd $MNT && find . -type f | sort | xargs md5sum) > $TMP/sums
+}
+
+mkdir -p $MNT
+load_flash
+echo "testing checkpoints on mtd$MTD ($NAME)"
+
+# The flash starts erased; the first mount sets it up
+mount_fs scan
+fill 20
+record
+umount $MNT
+
+echo "remount after populating"
+mount_fs checkpoint
+check "remount"
+
+rm -r $MNT/dir3
+mv $MNT/dir4 $MNT/dir4.moved
+fill 5
+record
+umount $MNT
+
+echo "remount after changes"
+mount_fs checkpoint
+check "second remount"
+
+if [ $TYPE = nor ]; then
+	echo "mount of a power-cut copy"
+	rm -r $MNT/dir5
+	fill 2
+	record
+	dd if=/dev/mtd$MTD of=$TMP/image bs=128k 2> /dev/null
+	umount $MNT
+	unload_flash
+	load_flash
+	dd if=$TMP/image of=/dev/mtd$MTD bs=128k 2> /dev/null
+	mount_fs scan
+	check "power-cut copy"
+fi
+
+umount $MNT
+unload_flash
+rm -r $TMP
+
+if [ $FAILED = 0 ]; then
+	echo "PASS"
+else
+	exit 1
+fi